@@ -0,0 +1,124 @@
+//
+//  Column.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _COLUMN_H_
+#define _COLUMN_H_
+
+#include <cstddef>
+#include <type_traits>
+
+#include "JSON.h"
+
+namespace otita {
+
+namespace tool {
+
+// Read-only view of numbers to plot that need not be contiguous doubles:
+// any arithmetic type, one value every stride bytes, a field of an array of
+// structs, or the elements of a JSON array. Values are converted to double
+// a chunk at a time by whoever reads them, so no converted copy of the
+// whole column is made. The viewed data must outlive the view.
+class Column {
+public:
+  Column() : _data(nullptr), _stride(0), _read(nullptr), _doubles(false) {}
+  template <class T>
+  Column(const T *data, size_t stride=sizeof(T))
+    : _data(data), _stride(stride), _read(&Column::_readArithmetic<T>),
+      _doubles(::std::is_same<T, double>::value && stride==sizeof(double)) {
+    static_assert(::std::is_arithmetic<T>::value, "Column needs an arithmetic type");
+  }
+  // data[i].*field for each i; data may be null for an empty column
+  template <class S, class T>
+  Column(const S *data, const T S::*field)
+    : _data((data==nullptr) ? nullptr : &(data->*field)), _stride(sizeof(S)),
+      _read(&Column::_readArithmetic<T>), _doubles(false) {
+    static_assert(::std::is_arithmetic<T>::value, "Column needs an arithmetic type");
+  }
+  // Reading an element that is not a number throws, on the reading thread
+  // or, from parallel_for, on the thread that called it.
+  Column(const JSON &array)
+    : _data(&array), _stride(0), _read(&Column::_readJSON), _doubles(false) {}
+  // Converts the n values from begin on into out.
+  void read(size_t begin, size_t n, double *out) const {
+    _read(_data, _stride, begin, n, out);
+  }
+  double operator [](size_t i) const {
+    double value;
+    _read(_data, _stride, i, 1, &value);
+    return value;
+  }
+  // The values themselves when they are contiguous doubles, else nullptr.
+  const double *doubles() const {
+    return _doubles ? static_cast<const double *>(_data) : nullptr;
+  }
+private:
+  typedef void (*read_function)(const void *data,
+                                size_t stride,
+                                size_t begin,
+                                size_t n,
+                                double *out);
+  const void *_data;
+  size_t _stride;
+  read_function _read;
+  bool _doubles;
+  template <class T>
+  static void _readArithmetic(const void *data,
+                              size_t stride,
+                              size_t begin,
+                              size_t n,
+                              double *out) {
+    const char *p = static_cast<const char *>(data) + begin*stride;
+    if (stride==sizeof(T)) {
+      const T *values = reinterpret_cast<const T *>(p);
+      for (size_t i=0; i<n; i++) {
+        out[i] = double(values[i]);
+      }
+      return;
+    }
+    for (size_t i=0; i<n; i++) {
+      out[i] = double(*reinterpret_cast<const T *>(p + i*stride));
+    }
+  }
+  static void _readJSON(const void *data,
+                        size_t,
+                        size_t begin,
+                        size_t n,
+                        double *out) {
+    const JSON &array = *static_cast<const JSON *>(data);
+    for (size_t i=0; i<n; i++) {
+      out[i] = array[begin+i].number();
+    }
+  }
+};
+
+} // tool
+
+} // otita
+
+#endif // _COLUMN_H_
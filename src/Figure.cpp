@@ -0,0 +1,1499 @@
+//
+//  Figure.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include "Figure.h"
+#include "parallel.h"
+
+using namespace ::std;
+using namespace ::otita::tool;
+
+namespace otita {
+
+namespace tool {
+
+// gnuplot's default line type colours
+static const unsigned _palette[] = {
+  0x9400d3, 0x009e73, 0x56b4e9, 0xe69f00,
+  0xf0e442, 0x0072b2, 0xe51e10, 0x000000,
+};
+static const size_t _palette_size = sizeof(_palette)/sizeof(_palette[0]);
+
+static const struct {
+  const char *name;
+  unsigned rgb;
+} _color_names[] = {
+  {"black", 0x000000}, {"white", 0xffffff}, {"gray", 0xc0c0c0},
+  {"grey", 0xc0c0c0}, {"red", 0xff0000}, {"green", 0x00ff00},
+  {"blue", 0x0000ff}, {"cyan", 0x00ffff}, {"magenta", 0xff00ff},
+  {"yellow", 0xffff00}, {"orange", 0xffa500}, {"purple", 0xc080ff},
+  {"brown", 0xa52a2a}, {"dark-red", 0x8b0000}, {"dark-green", 0x006400},
+  {"dark-blue", 0x00008b}, {"dark-gray", 0xa0a0a0}, {"dark-grey", 0xa0a0a0},
+};
+
+// 5x7 glyphs for ' ' to '~', one byte per column, least significant bit on
+// top.
+static const unsigned char _font[95][5] = {
+  {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5f,0x00,0x00},
+  {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7f,0x14,0x7f,0x14},
+  {0x24,0x2a,0x7f,0x2a,0x12}, {0x23,0x13,0x08,0x64,0x62},
+  {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00},
+  {0x00,0x1c,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1c,0x00},
+  {0x14,0x08,0x3e,0x08,0x14}, {0x08,0x08,0x3e,0x08,0x08},
+  {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08},
+  {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+  {0x3e,0x51,0x49,0x45,0x3e}, {0x00,0x42,0x7f,0x40,0x00},
+  {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4b,0x31},
+  {0x18,0x14,0x12,0x7f,0x10}, {0x27,0x45,0x45,0x45,0x39},
+  {0x3c,0x4a,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+  {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1e},
+  {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+  {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14},
+  {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+  {0x32,0x49,0x79,0x41,0x3e}, {0x7e,0x11,0x11,0x11,0x7e},
+  {0x7f,0x49,0x49,0x49,0x36}, {0x3e,0x41,0x41,0x41,0x22},
+  {0x7f,0x41,0x41,0x22,0x1c}, {0x7f,0x49,0x49,0x49,0x41},
+  {0x7f,0x09,0x09,0x09,0x01}, {0x3e,0x41,0x49,0x49,0x7a},
+  {0x7f,0x08,0x08,0x08,0x7f}, {0x00,0x41,0x7f,0x41,0x00},
+  {0x20,0x40,0x41,0x3f,0x01}, {0x7f,0x08,0x14,0x22,0x41},
+  {0x7f,0x40,0x40,0x40,0x40}, {0x7f,0x02,0x0c,0x02,0x7f},
+  {0x7f,0x04,0x08,0x10,0x7f}, {0x3e,0x41,0x41,0x41,0x3e},
+  {0x7f,0x09,0x09,0x09,0x06}, {0x3e,0x41,0x51,0x21,0x5e},
+  {0x7f,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+  {0x01,0x01,0x7f,0x01,0x01}, {0x3f,0x40,0x40,0x40,0x3f},
+  {0x1f,0x20,0x40,0x20,0x1f}, {0x3f,0x40,0x38,0x40,0x3f},
+  {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07},
+  {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7f,0x41,0x41,0x00},
+  {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7f,0x00},
+  {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+  {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78},
+  {0x7f,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+  {0x38,0x44,0x44,0x48,0x7f}, {0x38,0x54,0x54,0x54,0x18},
+  {0x08,0x7e,0x09,0x01,0x02}, {0x0c,0x52,0x52,0x52,0x3e},
+  {0x7f,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7d,0x40,0x00},
+  {0x20,0x40,0x44,0x3d,0x00}, {0x7f,0x10,0x28,0x44,0x00},
+  {0x00,0x41,0x7f,0x40,0x00}, {0x7c,0x04,0x18,0x04,0x78},
+  {0x7c,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+  {0x7c,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7c},
+  {0x7c,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+  {0x04,0x3f,0x44,0x40,0x20}, {0x3c,0x40,0x40,0x20,0x7c},
+  {0x1c,0x20,0x40,0x20,0x1c}, {0x3c,0x40,0x30,0x40,0x3c},
+  {0x44,0x28,0x10,0x28,0x44}, {0x0c,0x50,0x50,0x50,0x3c},
+  {0x44,0x64,0x54,0x4c,0x44}, {0x00,0x08,0x36,0x41,0x00},
+  {0x00,0x00,0x7f,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00},
+  {0x08,0x04,0x08,0x10,0x08},
+};
+
+// Where a figure is drawn. Coordinates are in output units with y pointing
+// down; a NaN coordinate breaks a line.
+class Canvas {
+public:
+  virtual ~Canvas() {}
+  virtual double charWidth() const = 0;
+  virtual double charHeight() const = 0;
+  virtual void polyline(const double *x,
+                        const double *y,
+                        size_t n,
+                        unsigned color,
+                        double width) = 0;
+  // A plus of the given half size at every point, or a dot if size is 0.
+  virtual void marks(const double *x,
+                     const double *y,
+                     size_t n,
+                     unsigned color,
+                     double size) = 0;
+  // (x, y) is the middle of the left end (align<0), the centre (align==0)
+  // or the right end (align>0) of the text.
+  virtual void text(double x, double y, const string &text, int align) = 0;
+  // Fills the rectangle with a grid of columns by rows colours, the first
+  // row at the top.
+  virtual void image(double left,
+                     double top,
+                     double right,
+                     double bottom,
+                     size_t columns,
+                     size_t rows,
+                     const unsigned *colors) = 0;
+  virtual void clip(double left, double top, double right, double bottom) = 0;
+  virtual void unclip() = 0;
+};
+
+// Records the drawing and rasterizes it when written. Rows are split into
+// bands that are rasterized in parallel, each band going through the whole
+// drawing in order, so no pixel is written by two threads.
+class RasterCanvas : public Canvas {
+public:
+  RasterCanvas(size_t width, size_t height);
+  double charWidth() const;
+  double charHeight() const;
+  void polyline(const double *x,
+                const double *y,
+                size_t n,
+                unsigned color,
+                double width);
+  void marks(const double *x,
+             const double *y,
+             size_t n,
+             unsigned color,
+             double size);
+  void text(double x, double y, const string &text, int align);
+  void image(double left,
+             double top,
+             double right,
+             double bottom,
+             size_t columns,
+             size_t rows,
+             const unsigned *colors);
+  void clip(double left, double top, double right, double bottom);
+  void unclip();
+  bool writePNG(const string &filepath);
+private:
+  enum kind_t {
+    KIND_LINE,
+    KIND_MARKS,
+    KIND_TEXT,
+    KIND_IMAGE,
+  };
+  struct Clip {
+    long left;
+    long top;
+    long right;
+    long bottom;
+  };
+  struct Primitive {
+    kind_t kind;
+    vector<double> x;
+    vector<double> y;
+    unsigned color;
+    double size;
+    string text;
+    // grid of an image, whose corners are in x and y
+    size_t columns;
+    vector<unsigned> colors;
+    Clip clip;
+  };
+  size_t _width;
+  size_t _height;
+  vector<unsigned char> _rgb;
+  vector<Primitive> _primitives;
+  Clip _clip;
+  void _rasterize(size_t row_begin, size_t row_end);
+  void _fill(long left, long top, long right, long bottom,
+             unsigned color, const Clip &clip);
+  void _segment(double x0, double y0, double x1, double y1,
+                double width, unsigned color, const Clip &clip);
+  void _glyphs(const Primitive &primitive, const Clip &clip);
+  void _pixels(const Primitive &primitive, const Clip &clip);
+};
+
+RasterCanvas::RasterCanvas(size_t width, size_t height)
+  : _width(width), _height(height), _rgb(width*height*3, 0xff) {
+  unclip();
+}
+
+double RasterCanvas::charWidth() const {
+  return 6;
+}
+
+double RasterCanvas::charHeight() const {
+  return 10;
+}
+
+void RasterCanvas::polyline(const double *x,
+                            const double *y,
+                            size_t n,
+                            unsigned color,
+                            double width) {
+  Primitive primitive;
+  primitive.kind = KIND_LINE;
+  primitive.x.assign(x, x + n);
+  primitive.y.assign(y, y + n);
+  primitive.color = color;
+  primitive.size = width;
+  primitive.clip = _clip;
+  _primitives.push_back(move(primitive));
+}
+
+void RasterCanvas::marks(const double *x,
+                         const double *y,
+                         size_t n,
+                         unsigned color,
+                         double size) {
+  Primitive primitive;
+  primitive.kind = KIND_MARKS;
+  primitive.x.assign(x, x + n);
+  primitive.y.assign(y, y + n);
+  primitive.color = color;
+  primitive.size = size;
+  primitive.clip = _clip;
+  _primitives.push_back(move(primitive));
+}
+
+void RasterCanvas::text(double x, double y, const string &text, int align) {
+  Primitive primitive;
+  primitive.kind = KIND_TEXT;
+  double width = 6*double(text.size()) - 1;
+  double left = (align<0) ? x : (align==0) ? x - width/2 : x - width;
+  primitive.x.push_back(floor(left + 0.5));
+  primitive.y.push_back(floor(y - 3.5 + 0.5));
+  primitive.color = 0x000000;
+  primitive.size = 0;
+  primitive.text = text;
+  primitive.clip = _clip;
+  _primitives.push_back(move(primitive));
+}
+
+void RasterCanvas::image(double left,
+                         double top,
+                         double right,
+                         double bottom,
+                         size_t columns,
+                         size_t rows,
+                         const unsigned *colors) {
+  Primitive primitive;
+  primitive.kind = KIND_IMAGE;
+  primitive.x = {left, right};
+  primitive.y = {top, bottom};
+  primitive.color = 0;
+  primitive.size = 0;
+  primitive.columns = columns;
+  primitive.colors.assign(colors, colors + columns*rows);
+  primitive.clip = _clip;
+  _primitives.push_back(move(primitive));
+}
+
+void RasterCanvas::clip(double left, double top, double right, double bottom) {
+  _clip.left = long(floor(left));
+  _clip.top = long(floor(top));
+  _clip.right = long(ceil(right));
+  _clip.bottom = long(ceil(bottom));
+}
+
+void RasterCanvas::unclip() {
+  _clip.left = 0;
+  _clip.top = 0;
+  _clip.right = long(_width) - 1;
+  _clip.bottom = long(_height) - 1;
+}
+
+void RasterCanvas::_rasterize(size_t row_begin, size_t row_end) {
+  for (const Primitive &primitive : _primitives) {
+    Clip clip = primitive.clip;
+    clip.top = max(clip.top, long(row_begin));
+    clip.bottom = min(clip.bottom, long(row_end) - 1);
+    if (clip.top>clip.bottom) {
+      continue;
+    }
+    if (primitive.kind==KIND_TEXT) {
+      _glyphs(primitive, clip);
+    }
+    else if (primitive.kind==KIND_IMAGE) {
+      _pixels(primitive, clip);
+    }
+    else if (primitive.kind==KIND_MARKS) {
+      long arm = long(floor(primitive.size + 0.5));
+      for (size_t i=0; i<primitive.x.size(); i++) {
+        double x = primitive.x[i];
+        double y = primitive.y[i];
+        if (!isfinite(x) || !isfinite(y) ||
+            y<clip.top - arm - 1 || y>clip.bottom + arm + 1) {
+          continue;
+        }
+        long cx = long(floor(x + 0.5));
+        long cy = long(floor(y + 0.5));
+        _fill(cx - arm, cy, cx + arm, cy, primitive.color, clip);
+        _fill(cx, cy - arm, cx, cy + arm, primitive.color, clip);
+      }
+    }
+    else {
+      for (size_t i=1; i<primitive.x.size(); i++) {
+        _segment(primitive.x[i-1], primitive.y[i-1],
+                 primitive.x[i], primitive.y[i],
+                 primitive.size, primitive.color, clip);
+      }
+      if (primitive.x.size()==1) {
+        _segment(primitive.x[0], primitive.y[0],
+                 primitive.x[0], primitive.y[0],
+                 primitive.size, primitive.color, clip);
+      }
+    }
+  }
+}
+
+void RasterCanvas::_fill(long left, long top, long right, long bottom,
+                         unsigned color, const Clip &clip) {
+  left = max(left, clip.left);
+  top = max(top, clip.top);
+  right = min(right, clip.right);
+  bottom = min(bottom, clip.bottom);
+  unsigned char r = (color>>16) & 0xff;
+  unsigned char g = (color>>8) & 0xff;
+  unsigned char b = color & 0xff;
+  for (long y=top; y<=bottom; y++) {
+    unsigned char *p = &_rgb[(size_t(y)*_width + size_t(left))*3];
+    for (long x=left; x<=right; x++) {
+      *p++ = r;
+      *p++ = g;
+      *p++ = b;
+    }
+  }
+}
+
+// Stamps a square pen along the segment, visiting only the part of it that
+// can reach the rows of clip.
+void RasterCanvas::_segment(double x0, double y0, double x1, double y1,
+                            double width, unsigned color, const Clip &clip) {
+  if (!isfinite(x0) || !isfinite(y0) || !isfinite(x1) || !isfinite(y1)) {
+    return;
+  }
+  long pen = max(long(floor(width + 0.5)), 1L);
+  long before = (pen - 1)/2;
+  long after = pen - 1 - before;
+  double pad = double(pen) + 1;
+  double dx = x1 - x0;
+  double dy = y1 - y0;
+  double t0 = 0;
+  double t1 = 1;
+  if (dy!=0) {
+    double ta = (clip.top - pad - y0)/dy;
+    double tb = (clip.bottom + pad - y0)/dy;
+    t0 = max(t0, min(ta, tb));
+    t1 = min(t1, max(ta, tb));
+    if (t0>t1) {
+      return;
+    }
+  }
+  else if (y0<clip.top - pad || y0>clip.bottom + pad) {
+    return;
+  }
+  double length = max(fabs(dx), fabs(dy))*(t1 - t0);
+  size_t steps = size_t(ceil(length));
+  for (size_t k=0; k<=steps; k++) {
+    double t = (steps==0) ? t0 : t0 + (t1 - t0)*double(k)/double(steps);
+    long x = long(floor(x0 + dx*t + 0.5));
+    long y = long(floor(y0 + dy*t + 0.5));
+    _fill(x - before, y - before, x + after, y + after, color, clip);
+  }
+}
+
+void RasterCanvas::_glyphs(const Primitive &primitive, const Clip &clip) {
+  long left = long(primitive.x[0]);
+  long top = long(primitive.y[0]);
+  for (size_t i=0; i<primitive.text.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(primitive.text[i]);
+    const unsigned char *glyph = _font[(c>=0x20 && c<0x7f) ? c - 0x20 : '?' - 0x20];
+    for (long column=0; column<5; column++) {
+      for (long row=0; row<7; row++) {
+        if (glyph[column] & (1<<row)) {
+          long x = left + long(6*i) + column;
+          long y = top + row;
+          _fill(x, y, x, y, primitive.color, clip);
+        }
+      }
+    }
+  }
+}
+
+// Each pixel takes the colour of the cell under its centre.
+void RasterCanvas::_pixels(const Primitive &primitive, const Clip &clip) {
+  double left = primitive.x[0];
+  double width = primitive.x[1] - left;
+  double top = primitive.y[0];
+  double height = primitive.y[1] - top;
+  size_t columns = primitive.columns;
+  size_t rows = (columns==0) ? 0 : primitive.colors.size()/columns;
+  if (rows==0 || !(width>0) || !(height>0)) {
+    return;
+  }
+  long x_begin = max(long(ceil(left - 0.5)), clip.left);
+  long x_end = min(long(ceil(left + width - 0.5)) - 1, clip.right);
+  long y_begin = max(long(ceil(top - 0.5)), clip.top);
+  long y_end = min(long(ceil(top + height - 0.5)) - 1, clip.bottom);
+  for (long y=y_begin; y<=y_end; y++) {
+    size_t row = min(size_t((double(y) + 0.5 - top)/height*double(rows)), rows - 1);
+    const unsigned *colors = &primitive.colors[row*columns];
+    for (long x=x_begin; x<=x_end; x++) {
+      size_t column = min(size_t((double(x) + 0.5 - left)/width*double(columns)), columns - 1);
+      _fill(x, y, x, y, colors[column], clip);
+    }
+  }
+}
+
+static const uint32_t *_crc_table() {
+  static uint32_t table[256];
+  static bool initialized = [&]() {
+    for (uint32_t n=0; n<256; n++) {
+      uint32_t c = n;
+      for (int k=0; k<8; k++) {
+        c = (c & 1) ? 0xedb88320u ^ (c>>1) : c>>1;
+      }
+      table[n] = c;
+    }
+    return true;
+  }();
+  (void)initialized;
+  return table;
+}
+
+static uint32_t _crc(const unsigned char *data, size_t len, uint32_t crc=0) {
+  const uint32_t *table = _crc_table();
+  crc = ~crc;
+  for (size_t i=0; i<len; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc>>8);
+  }
+  return ~crc;
+}
+
+static uint32_t _adler32(const unsigned char *data, size_t len) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (len>0) {
+    // the largest run before the sums can overflow
+    size_t n = min(len, size_t(5552));
+    for (size_t i=0; i<n; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += n;
+    len -= n;
+  }
+  return (b<<16) | a;
+}
+
+// Bits go out least significant first; Huffman codes most significant first.
+class BitWriter {
+public:
+  BitWriter(vector<unsigned char> &out) : _out(out), _bits(0), _count(0) {}
+  void put(uint32_t value, int n) {
+    _bits |= value<<_count;
+    _count += n;
+    while (_count>=8) {
+      _out.push_back(_bits & 0xff);
+      _bits >>= 8;
+      _count -= 8;
+    }
+  }
+  void code(uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for (int i=0; i<n; i++) {
+      reversed = (reversed<<1) | ((code>>i) & 1);
+    }
+    put(reversed, n);
+  }
+  void flush() {
+    if (_count>0) {
+      _out.push_back(_bits & 0xff);
+    }
+    _bits = 0;
+    _count = 0;
+  }
+private:
+  vector<unsigned char> &_out;
+  uint32_t _bits;
+  int _count;
+};
+
+static void _literal(BitWriter &writer, unsigned symbol) {
+  if (symbol<144) {
+    writer.code(0x30 + symbol, 8);
+  }
+  else if (symbol<256) {
+    writer.code(0x190 + symbol - 144, 9);
+  }
+  else if (symbol<280) {
+    writer.code(symbol - 256, 7);
+  }
+  else {
+    writer.code(0xc0 + symbol - 280, 8);
+  }
+}
+
+// zlib stream of one fixed-Huffman deflate block with greedy LZ77 matching.
+// Plots are mostly runs of background, which this compresses well.
+static vector<unsigned char> _zlib(const vector<unsigned char> &data) {
+  static const unsigned length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+  };
+  static const int length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+  };
+  static const unsigned distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577,
+  };
+  static const int distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+  };
+  static const size_t window = 32768;
+  static const size_t hash_bits = 15;
+  
+  vector<unsigned char> out;
+  out.reserve(data.size()/8 + 64);
+  out.push_back(0x78);
+  out.push_back(0x01);
+  BitWriter writer(out);
+  writer.put(1, 1);
+  writer.put(1, 2);
+  
+  vector<long> head(size_t(1)<<hash_bits, -1);
+  size_t len = data.size();
+  size_t i = 0;
+  while (i<len) {
+    size_t match = 0;
+    size_t distance = 0;
+    if (i+3<=len) {
+      uint32_t h = ((uint32_t(data[i])<<16) | (uint32_t(data[i+1])<<8) | data[i+2]);
+      h = (h*2654435761u)>>(32 - hash_bits);
+      long candidate = head[h];
+      head[h] = long(i);
+      if (candidate>=0 && i - size_t(candidate)<=window) {
+        size_t limit = min(len - i, size_t(258));
+        const unsigned char *a = &data[size_t(candidate)];
+        const unsigned char *b = &data[i];
+        while (match<limit && a[match]==b[match]) {
+          match++;
+        }
+        distance = i - size_t(candidate);
+      }
+    }
+    if (match<3) {
+      _literal(writer, data[i]);
+      i++;
+      continue;
+    }
+    size_t code = upper_bound(length_base, length_base + 29, unsigned(match)) - length_base - 1;
+    _literal(writer, 257 + unsigned(code));
+    writer.put(uint32_t(match - length_base[code]), length_extra[code]);
+    code = upper_bound(distance_base, distance_base + 30, unsigned(distance)) - distance_base - 1;
+    writer.code(uint32_t(code), 5);
+    writer.put(uint32_t(distance - distance_base[code]), distance_extra[code]);
+    // index the matched positions too, so long runs keep matching
+    for (size_t j=i+1; j<i+match && j+3<=len; j++) {
+      uint32_t h = ((uint32_t(data[j])<<16) | (uint32_t(data[j+1])<<8) | data[j+2]);
+      head[(h*2654435761u)>>(32 - hash_bits)] = long(j);
+    }
+    i += match;
+  }
+  _literal(writer, 256);
+  writer.flush();
+  uint32_t adler = _adler32(data.data(), data.size());
+  for (int shift=24; shift>=0; shift-=8) {
+    out.push_back((adler>>shift) & 0xff);
+  }
+  return out;
+}
+
+static void _chunk(ostream &out, const char *type, const vector<unsigned char> &data) {
+  unsigned char header[8];
+  uint32_t len = uint32_t(data.size());
+  for (int i=0; i<4; i++) {
+    header[i] = (len>>(24 - 8*i)) & 0xff;
+    header[4+i] = static_cast<unsigned char>(type[i]);
+  }
+  uint32_t crc = _crc(header + 4, 4);
+  crc = _crc(data.data(), data.size(), crc);
+  unsigned char trailer[4];
+  for (int i=0; i<4; i++) {
+    trailer[i] = (crc>>(24 - 8*i)) & 0xff;
+  }
+  out.write(reinterpret_cast<const char *>(header), 8);
+  out.write(reinterpret_cast<const char *>(data.data()), streamsize(data.size()));
+  out.write(reinterpret_cast<const char *>(trailer), 4);
+}
+
+bool RasterCanvas::writePNG(const string &filepath) {
+  parallel_for(0, _height, 32, [this](size_t row_begin, size_t row_end) {
+    _rasterize(row_begin, row_end);
+  });
+  
+  vector<unsigned char> raw;
+  raw.reserve((_width*3 + 1)*_height);
+  for (size_t y=0; y<_height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), &_rgb[y*_width*3], &_rgb[y*_width*3] + _width*3);
+  }
+  vector<unsigned char> header(13, 0);
+  for (int i=0; i<4; i++) {
+    header[i] = (_width>>(24 - 8*i)) & 0xff;
+    header[4+i] = (_height>>(24 - 8*i)) & 0xff;
+  }
+  header[8] = 8;
+  header[9] = 2;
+  
+  ofstream out(filepath.c_str(), ios::binary);
+  if (!out.is_open()) {
+    cerr << "cannot open " << filepath << endl;
+    return false;
+  }
+  static const char signature[] = "\x89PNG\r\n\x1a\n";
+  out.write(signature, 8);
+  _chunk(out, "IHDR", header);
+  _chunk(out, "IDAT", _zlib(raw));
+  _chunk(out, "IEND", vector<unsigned char>());
+  return out.good();
+}
+
+static string _number(double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.2f", value);
+  return buf;
+}
+
+static string _hex(unsigned color) {
+  char buf[8];
+  snprintf(buf, sizeof(buf), "#%06x", color & 0xffffff);
+  return buf;
+}
+
+class SVGCanvas : public Canvas {
+public:
+  SVGCanvas(ostream &out, double width, double height);
+  double charWidth() const;
+  double charHeight() const;
+  void polyline(const double *x,
+                const double *y,
+                size_t n,
+                unsigned color,
+                double width);
+  void marks(const double *x,
+             const double *y,
+             size_t n,
+             unsigned color,
+             double size);
+  void text(double x, double y, const string &text, int align);
+  void image(double left,
+             double top,
+             double right,
+             double bottom,
+             size_t columns,
+             size_t rows,
+             const unsigned *colors);
+  void clip(double left, double top, double right, double bottom);
+  void unclip();
+  void finish();
+private:
+  ostream &_out;
+  bool _clipped;
+  size_t _clips;
+};
+
+SVGCanvas::SVGCanvas(ostream &out, double width, double height)
+  : _out(out), _clipped(false), _clips(0) {
+  _out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+       << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width
+       << "\" height=\"" << height << "\" viewBox=\"0 0 " << width << " "
+       << height << "\">\n"
+       << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+}
+
+double SVGCanvas::charWidth() const {
+  return 7;
+}
+
+double SVGCanvas::charHeight() const {
+  return 14;
+}
+
+void SVGCanvas::polyline(const double *x,
+                         const double *y,
+                         size_t n,
+                         unsigned color,
+                         double width) {
+  _out << "<path fill=\"none\" stroke=\"" << _hex(color)
+       << "\" stroke-width=\"" << width << "\" stroke-linejoin=\"round\" d=\"";
+  bool pen_down = false;
+  for (size_t i=0; i<n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i])) {
+      pen_down = false;
+      continue;
+    }
+    _out << (pen_down ? "L" : "M") << _number(x[i]) << " " << _number(y[i]) << " ";
+    pen_down = true;
+  }
+  _out << "\"/>\n";
+}
+
+void SVGCanvas::marks(const double *x,
+                      const double *y,
+                      size_t n,
+                      unsigned color,
+                      double size) {
+  _out << "<path fill=\"none\" stroke=\"" << _hex(color) << "\" d=\"";
+  for (size_t i=0; i<n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i])) {
+      continue;
+    }
+    if (size>0) {
+      _out << "M" << _number(x[i] - size) << " " << _number(y[i])
+           << "h" << _number(2*size)
+           << "M" << _number(x[i]) << " " << _number(y[i] - size)
+           << "v" << _number(2*size) << " ";
+    }
+    else {
+      _out << "M" << _number(x[i] - 0.5) << " " << _number(y[i]) << "h1 ";
+    }
+  }
+  _out << "\"/>\n";
+}
+
+void SVGCanvas::text(double x, double y, const string &text, int align) {
+  const char *anchor = (align<0) ? "start" : (align==0) ? "middle" : "end";
+  _out << "<text x=\"" << _number(x) << "\" y=\"" << _number(y + 4)
+       << "\" font-family=\"sans-serif\" font-size=\"12\" text-anchor=\""
+       << anchor << "\">";
+  for (char c : text) {
+    switch (c) {
+      case '&': _out << "&amp;"; break;
+      case '<': _out << "&lt;"; break;
+      case '>': _out << "&gt;"; break;
+      default: _out << c;
+    }
+  }
+  _out << "</text>\n";
+}
+
+// One rectangle per run of equal cells in a row.
+void SVGCanvas::image(double left,
+                      double top,
+                      double right,
+                      double bottom,
+                      size_t columns,
+                      size_t rows,
+                      const unsigned *colors) {
+  double width = (right - left)/double(columns);
+  double height = (bottom - top)/double(rows);
+  _out << "<g shape-rendering=\"crispEdges\">\n";
+  for (size_t row=0; row<rows; row++) {
+    const unsigned *cells = colors + row*columns;
+    size_t run = 0;
+    for (size_t column=1; column<=columns; column++) {
+      if (column<columns && cells[column]==cells[run]) {
+        continue;
+      }
+      _out << "<rect x=\"" << _number(left + width*double(run))
+           << "\" y=\"" << _number(top + height*double(row))
+           << "\" width=\"" << _number(width*double(column - run))
+           << "\" height=\"" << _number(height)
+           << "\" fill=\"" << _hex(cells[run]) << "\"/>\n";
+      run = column;
+    }
+  }
+  _out << "</g>\n";
+}
+
+void SVGCanvas::clip(double left, double top, double right, double bottom) {
+  unclip();
+  _clips++;
+  _out << "<clipPath id=\"clip" << _clips << "\"><rect x=\"" << _number(left)
+       << "\" y=\"" << _number(top) << "\" width=\"" << _number(right - left)
+       << "\" height=\"" << _number(bottom - top) << "\"/></clipPath>\n"
+       << "<g clip-path=\"url(#clip" << _clips << ")\">\n";
+  _clipped = true;
+}
+
+void SVGCanvas::unclip() {
+  if (_clipped) {
+    _out << "</g>\n";
+    _clipped = false;
+  }
+}
+
+void SVGCanvas::finish() {
+  unclip();
+  _out << "</svg>\n";
+}
+
+// Encapsulated PostScript with y pointing up; PostScript limits path
+// length, so long lines are stroked in pieces.
+class EPSCanvas : public Canvas {
+public:
+  EPSCanvas(ostream &out, double width, double height);
+  double charWidth() const;
+  double charHeight() const;
+  void polyline(const double *x,
+                const double *y,
+                size_t n,
+                unsigned color,
+                double width);
+  void marks(const double *x,
+             const double *y,
+             size_t n,
+             unsigned color,
+             double size);
+  void text(double x, double y, const string &text, int align);
+  void image(double left,
+             double top,
+             double right,
+             double bottom,
+             size_t columns,
+             size_t rows,
+             const unsigned *colors);
+  void clip(double left, double top, double right, double bottom);
+  void unclip();
+  void finish();
+private:
+  ostream &_out;
+  double _height;
+  bool _clipped;
+  void _color(unsigned color);
+};
+
+EPSCanvas::EPSCanvas(ostream &out, double width, double height)
+  : _out(out), _height(height), _clipped(false) {
+  _out << "%!PS-Adobe-3.0 EPSF-3.0\n"
+       << "%%BoundingBox: 0 0 " << long(ceil(width)) << " " << long(ceil(height)) << "\n"
+       << "%%EndComments\n"
+       << "/Helvetica findfont 10 scalefont setfont\n"
+       << "1 setlinejoin 1 setlinecap\n"
+       << "/M {moveto} bind def /L {lineto} bind def\n"
+       << "/T {/align exch def /s exch def moveto\n"
+       << "    s stringwidth pop align mul 0 rmoveto s show} bind def\n";
+}
+
+double EPSCanvas::charWidth() const {
+  return 5.5;
+}
+
+double EPSCanvas::charHeight() const {
+  return 11;
+}
+
+void EPSCanvas::_color(unsigned color) {
+  _out << ((color>>16) & 0xff)/255.0 << " " << ((color>>8) & 0xff)/255.0
+       << " " << (color & 0xff)/255.0 << " setrgbcolor\n";
+}
+
+void EPSCanvas::polyline(const double *x,
+                         const double *y,
+                         size_t n,
+                         unsigned color,
+                         double width) {
+  _color(color);
+  _out << width*0.5 << " setlinewidth\nnewpath\n";
+  size_t in_path = 0;
+  double last_x = 0;
+  double last_y = 0;
+  for (size_t i=0; i<n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i])) {
+      if (in_path>0) {
+        _out << "stroke newpath\n";
+      }
+      in_path = 0;
+      continue;
+    }
+    if (in_path==1000) {
+      _out << "stroke newpath\n" << _number(last_x) << " " << _number(_height - last_y) << " M\n";
+      in_path = 1;
+    }
+    _out << _number(x[i]) << " " << _number(_height - y[i]) << ((in_path>0) ? " L\n" : " M\n");
+    last_x = x[i];
+    last_y = y[i];
+    in_path++;
+  }
+  _out << "stroke\n";
+}
+
+void EPSCanvas::marks(const double *x,
+                      const double *y,
+                      size_t n,
+                      unsigned color,
+                      double size) {
+  _color(color);
+  _out << "0.5 setlinewidth\n";
+  double half = (size>0) ? size : 0.25;
+  for (size_t i=0; i<n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i])) {
+      continue;
+    }
+    double px = x[i];
+    double py = _height - y[i];
+    _out << "newpath " << _number(px - half) << " " << _number(py) << " M "
+         << _number(px + half) << " " << _number(py) << " L ";
+    if (size>0) {
+      _out << _number(px) << " " << _number(py - half) << " M "
+           << _number(px) << " " << _number(py + half) << " L ";
+    }
+    _out << "stroke\n";
+  }
+}
+
+void EPSCanvas::text(double x, double y, const string &text, int align) {
+  _color(0x000000);
+  _out << _number(x) << " " << _number(_height - y - 3.5) << " (";
+  for (char c : text) {
+    if (c=='(' || c==')' || c=='\\') {
+      _out << '\\';
+    }
+    _out << c;
+  }
+  _out << ") " << ((align<0) ? "0" : (align==0) ? "-0.5" : "-1") << " T\n";
+}
+
+void EPSCanvas::image(double left,
+                      double top,
+                      double right,
+                      double bottom,
+                      size_t columns,
+                      size_t rows,
+                      const unsigned *colors) {
+  _out << "gsave " << _number(left) << " " << _number(_height - bottom)
+       << " translate " << _number(right - left) << " " << _number(bottom - top)
+       << " scale\n" << columns << " " << rows << " 8 [" << columns << " 0 0 -"
+       << rows << " 0 " << rows << "]\n"
+       << "currentfile /ASCIIHexDecode filter false 3 colorimage\n";
+  char hex[8];
+  for (size_t i=0; i<columns*rows; i++) {
+    snprintf(hex, sizeof(hex), "%06x", colors[i] & 0xffffff);
+    _out << hex << ((i % 12==11) ? "\n" : "");
+  }
+  _out << ">\ngrestore\n";
+}
+
+void EPSCanvas::clip(double left, double top, double right, double bottom) {
+  unclip();
+  _out << "gsave newpath " << _number(left) << " " << _number(_height - bottom)
+       << " " << _number(right - left) << " " << _number(bottom - top)
+       << " rectclip\n";
+  _clipped = true;
+}
+
+void EPSCanvas::unclip() {
+  if (_clipped) {
+    _out << "grestore\n";
+    _clipped = false;
+  }
+}
+
+void EPSCanvas::finish() {
+  unclip();
+  _out << "showpage\n%%EOF\n";
+}
+
+// Autoscaled axis extended to whole ticks, like gnuplot's default.
+struct Axis {
+  double min;
+  double max;
+  vector<double> ticks;
+  Axis(double lo, double hi);
+  double map(double value, double from, double to) const {
+    return from + (value - min)/(max - min)*(to - from);
+  }
+};
+
+Axis::Axis(double lo, double hi) {
+  if (!(lo<=hi)) {
+    lo = -10;
+    hi = 10;
+  }
+  if (lo==hi) {
+    double margin = (lo==0) ? 1 : fabs(lo)*0.1;
+    lo -= margin;
+    hi += margin;
+  }
+  double rough = (hi - lo)/5;
+  double magnitude = pow(10, floor(log10(rough)));
+  double fraction = rough/magnitude;
+  double step = ((fraction<1.5) ? 1 : (fraction<3.5) ? 2 : (fraction<7.5) ? 5 : 10)*magnitude;
+  min = floor(lo/step)*step;
+  max = ceil(hi/step)*step;
+  for (double tick=min; tick<=max + step*1e-9; tick+=step) {
+    ticks.push_back((fabs(tick)<step*1e-9) ? 0 : tick);
+  }
+}
+
+static string _label(double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%g", value);
+  return buf;
+}
+
+static string _lower(string s) {
+  for (char &c : s) {
+    c = char(tolower(static_cast<unsigned char>(c)));
+  }
+  return s;
+}
+
+// Splits options into words; quoted strings keep their quote as first char.
+static vector<string> _words(const string &options) {
+  vector<string> words;
+  size_t i = 0;
+  while (i<options.size()) {
+    char c = options[i];
+    if (isspace(static_cast<unsigned char>(c)) || c==',') {
+      i++;
+    }
+    else if (c=='\'' || c=='"') {
+      size_t end = options.find(c, i+1);
+      if (end==string::npos) {
+        end = options.size();
+      }
+      words.push_back(options.substr(i, end - i));
+      i = end + 1;
+    }
+    else {
+      size_t end = i;
+      while (end<options.size() &&
+             !isspace(static_cast<unsigned char>(options[end])) &&
+             options[end]!=',' && options[end]!='\'' && options[end]!='"') {
+        end++;
+      }
+      words.push_back(options.substr(i, end - i));
+      i = end;
+    }
+  }
+  return words;
+}
+
+static bool _is(const string &word, const char *shortest, const char *full) {
+  string w = _lower(word);
+  return w.size()>=strlen(shortest) && string(full).compare(0, w.size(), w)==0;
+}
+
+static unsigned _color(const string &spec) {
+  string name = _lower(spec);
+  if (!name.empty() && name[0]=='#') {
+    return unsigned(strtoul(name.c_str() + 1, nullptr, 16)) & 0xffffff;
+  }
+  for (const auto &color : _color_names) {
+    if (name==color.name) {
+      return color.rgb;
+    }
+  }
+  cerr << "unknown colour: " << spec << endl;
+  return 0x000000;
+}
+
+// gnuplot's default palette, rgbformulae 7,5,15, at t in [0, 1].
+static unsigned _heat(double t) {
+  double r = sqrt(t);
+  double g = t*t*t;
+  double b = max(sin(2*M_PI*t), 0.0);
+  return (unsigned(r*255 + 0.5)<<16) | (unsigned(g*255 + 0.5)<<8) | unsigned(b*255 + 0.5);
+}
+
+static inline double _at(const vector<double> &x, size_t i) {
+  return x.empty() ? double(i) : x[i];
+}
+
+// Edges of box i of n, halfway to its neighbours as gnuplot draws boxes
+// without a box width.
+static void _box(const vector<double> &x, size_t n, size_t i, double &lo, double &hi) {
+  double at = _at(x, i);
+  double end = (n>1) ? fabs(_at(x, 1) - _at(x, 0)) : 1;
+  lo = at - ((i>0) ? (at - _at(x, i-1))/2 : end/2);
+  end = (n>1) ? fabs(_at(x, n-1) - _at(x, n-2)) : 1;
+  hi = at + ((i+1<n) ? (_at(x, i+1) - at)/2 : end/2);
+}
+
+Figure::Figure() {
+}
+
+size_t Figure::add(const string &options) {
+  Series series;
+  series.style = STYLE_POINTS;
+  series.line_width = 1;
+  series.point_size = 1;
+  series.color = _palette[_series.size() % _palette_size];
+  series.nx = 0;
+  series.ny = 0;
+  
+  vector<string> words = _words(options);
+  for (size_t i=0; i<words.size(); i++) {
+    const string &word = words[i];
+    bool has_next = (i+1<words.size());
+    if (_is(word, "w", "with") && has_next) {
+      const string &style = words[++i];
+      if (_is(style, "linesp", "linespoints") || _lower(style)=="lp") {
+        series.style = STYLE_LINESPOINTS;
+      }
+      else if (_is(style, "p", "points")) {
+        series.style = STYLE_POINTS;
+      }
+      else if (_is(style, "d", "dots")) {
+        series.style = STYLE_DOTS;
+      }
+      else if (_is(style, "boxes", "boxes")) {
+        series.style = STYLE_BOXES;
+      }
+      else if (_is(style, "ima", "image")) {
+        series.style = STYLE_IMAGE;
+      }
+      else {
+        series.style = STYLE_LINES;
+      }
+    }
+    else if (_is(word, "t", "title") && has_next) {
+      const string &title = words[++i];
+      series.title = (!title.empty() && (title[0]=='\'' || title[0]=='"')) ? title.substr(1) : title;
+    }
+    else if (_is(word, "not", "notitle")) {
+      series.title.clear();
+    }
+    else if ((_is(word, "linew", "linewidth") || _lower(word)=="lw") && has_next) {
+      series.line_width = atof(words[++i].c_str());
+    }
+    else if ((_is(word, "points", "pointsize") || _lower(word)=="ps") && has_next) {
+      series.point_size = atof(words[++i].c_str());
+    }
+    else if ((_is(word, "linec", "linecolor") || _lower(word)=="lc" ||
+              _is(word, "linet", "linetype") || _lower(word)=="lt") && has_next) {
+      const string &value = words[++i];
+      if (_is(value, "rgb", "rgbcolor") && i+1<words.size()) {
+        const string &spec = words[++i];
+        series.color = _color((!spec.empty() && (spec[0]=='\'' || spec[0]=='"')) ? spec.substr(1) : spec);
+      }
+      else {
+        long type = atol(value.c_str());
+        if (type>0) {
+          series.color = _palette[size_t(type - 1) % _palette_size];
+        }
+      }
+    }
+  }
+  _series.push_back(series);
+  return _series.size() - 1;
+}
+
+void Figure::set(size_t series,
+                 const double *x_begin,
+                 const double *y_begin,
+                 size_t len) {
+  Column x(x_begin);
+  set(series, (x_begin==nullptr) ? nullptr : &x, Column(y_begin), len);
+}
+
+void Figure::set(size_t series,
+                 const Column *x,
+                 const Column &y,
+                 size_t len) {
+  Series &s = _series[series];
+  if (x==nullptr) {
+    s.x.clear();
+  }
+  else {
+    s.x.resize(len);
+    x->read(0, len, s.x.data());
+  }
+  s.y.resize(len);
+  y.read(0, len, s.y.data());
+}
+
+void Figure::setImage(size_t series,
+                      size_t nx,
+                      size_t ny,
+                      double x_lo,
+                      double x_hi,
+                      double y_lo,
+                      double y_hi,
+                      const double *values) {
+  Series &s = _series[series];
+  s.x.clear();
+  s.y.assign(values, values + nx*ny);
+  s.nx = nx;
+  s.ny = ny;
+  s.bounds[0] = x_lo;
+  s.bounds[1] = x_hi;
+  s.bounds[2] = y_lo;
+  s.bounds[3] = y_hi;
+}
+
+size_t Figure::size() const {
+  return _series.size();
+}
+
+bool Figure::values(size_t series,
+                    const vector<double> *&x,
+                    const vector<double> *&y,
+                    size_t &nx,
+                    size_t &ny,
+                    double *bounds) const {
+  const Series &s = _series[series];
+  x = &s.x;
+  y = &s.y;
+  if (s.style!=STYLE_IMAGE) {
+    return false;
+  }
+  nx = s.nx;
+  ny = s.ny;
+  copy(s.bounds, s.bounds + 4, bounds);
+  return true;
+}
+
+bool Figure::write(const string &filepath) const {
+  size_t dot = filepath.rfind('.');
+  string extension;
+  if (dot!=string::npos && filepath.find('/', dot)==string::npos) {
+    extension = _lower(filepath.substr(dot));
+  }
+  if (extension!=".png" && extension!=".svg" && extension!=".eps" && extension!=".ps") {
+    cerr << "cannot draw " << filepath << ": use .png, .svg or .eps" << endl;
+    return false;
+  }
+  if (extension==".png") {
+    RasterCanvas canvas(640, 480);
+    _draw(canvas, 640, 480);
+    return canvas.writePNG(filepath);
+  }
+  ofstream out(filepath.c_str());
+  if (!out.is_open()) {
+    cerr << "cannot open " << filepath << endl;
+    return false;
+  }
+  if (extension==".svg") {
+    SVGCanvas canvas(out, 640, 480);
+    _draw(canvas, 640, 480);
+    canvas.finish();
+  }
+  else {
+    // gnuplot's default 5 x 3.5 inch
+    EPSCanvas canvas(out, 360, 252);
+    _draw(canvas, 360, 252);
+    canvas.finish();
+  }
+  return out.good();
+}
+
+Figure::~Figure() {
+}
+
+void Figure::_draw(Canvas &canvas, double width, double height) const {
+  double x_lo = INFINITY;
+  double x_hi = -INFINITY;
+  double y_lo = INFINITY;
+  double y_hi = -INFINITY;
+  for (const Series &s : _series) {
+    if (s.style==STYLE_IMAGE) {
+      if (!s.y.empty()) {
+        x_lo = min(x_lo, s.bounds[0]);
+        x_hi = max(x_hi, s.bounds[1]);
+        y_lo = min(y_lo, s.bounds[2]);
+        y_hi = max(y_hi, s.bounds[3]);
+      }
+      continue;
+    }
+    for (size_t i=0; i<s.y.size(); i++) {
+      double x = _at(s.x, i);
+      double y = s.y[i];
+      if (isfinite(x) && isfinite(y)) {
+        double lo = x;
+        double hi = x;
+        if (s.style==STYLE_BOXES) {
+          // boxes stand on y=0
+          _box(s.x, s.y.size(), i, lo, hi);
+          y_lo = min(y_lo, 0.0);
+          y_hi = max(y_hi, 0.0);
+        }
+        x_lo = min(x_lo, lo);
+        x_hi = max(x_hi, hi);
+        y_lo = min(y_lo, y);
+        y_hi = max(y_hi, y);
+      }
+    }
+  }
+  Axis x_axis(x_lo, x_hi);
+  Axis y_axis(y_lo, y_hi);
+  
+  double cw = canvas.charWidth();
+  double ch = canvas.charHeight();
+  size_t label_chars = 0;
+  for (double tick : y_axis.ticks) {
+    label_chars = max(label_chars, _label(tick).size());
+  }
+  double left = floor(double(label_chars + 2)*cw);
+  double right = floor(width - 2*cw);
+  double top = floor(ch);
+  double bottom = floor(height - 2.5*ch);
+  double tick_size = 0.5*ch;
+  
+  double frame_x[5] = {left, right, right, left, left};
+  double frame_y[5] = {top, top, bottom, bottom, top};
+  canvas.polyline(frame_x, frame_y, 5, 0x000000, 1);
+  for (double tick : x_axis.ticks) {
+    double x = floor(x_axis.map(tick, left, right)) + 0.5;
+    double tick_x[2] = {x, x};
+    double tick_y[2] = {bottom, bottom - tick_size};
+    canvas.polyline(tick_x, tick_y, 2, 0x000000, 1);
+    tick_y[0] = top;
+    tick_y[1] = top + tick_size;
+    canvas.polyline(tick_x, tick_y, 2, 0x000000, 1);
+    canvas.text(x, bottom + ch, _label(tick), 0);
+  }
+  for (double tick : y_axis.ticks) {
+    double y = floor(y_axis.map(tick, bottom, top)) + 0.5;
+    double tick_x[2] = {left, left + tick_size};
+    double tick_y[2] = {y, y};
+    canvas.polyline(tick_x, tick_y, 2, 0x000000, 1);
+    tick_x[0] = right;
+    tick_x[1] = right - tick_size;
+    canvas.polyline(tick_x, tick_y, 2, 0x000000, 1);
+    canvas.text(left - cw, y, _label(tick), 1);
+  }
+  
+  canvas.clip(left, top, right, bottom);
+  vector<double> px;
+  vector<double> py;
+  for (const Series &s : _series) {
+    size_t n = s.y.size();
+    if (s.style==STYLE_IMAGE) {
+      if (n>0) {
+        _drawImage(canvas, s, x_axis.map(s.bounds[0], left, right),
+                   y_axis.map(s.bounds[3], bottom, top),
+                   x_axis.map(s.bounds[1], left, right),
+                   y_axis.map(s.bounds[2], bottom, top));
+      }
+      continue;
+    }
+    if (s.style==STYLE_BOXES) {
+      // outline of every box, broken by NaN
+      px.assign(6*n, NAN);
+      py.assign(6*n, NAN);
+      double base = y_axis.map(max(min(0.0, y_axis.max), y_axis.min), bottom, top);
+      parallel_for(0, n, 1<<14, [&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; i++) {
+          if (!isfinite(_at(s.x, i)) || !isfinite(s.y[i])) {
+            continue;
+          }
+          double lo;
+          double hi;
+          _box(s.x, n, i, lo, hi);
+          double x0 = x_axis.map(lo, left, right);
+          double x1 = x_axis.map(hi, left, right);
+          double y = y_axis.map(s.y[i], bottom, top);
+          double corner_x[5] = {x0, x0, x1, x1, x0};
+          double corner_y[5] = {base, y, y, base, base};
+          copy(corner_x, corner_x + 5, &px[6*i]);
+          copy(corner_y, corner_y + 5, &py[6*i]);
+        }
+      });
+      canvas.polyline(px.data(), py.data(), 6*n, s.color, s.line_width);
+      continue;
+    }
+    px.resize(n);
+    py.resize(n);
+    parallel_for(0, n, 1<<16, [&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; i++) {
+        double x = s.x.empty() ? double(i) : s.x[i];
+        bool finite = isfinite(x) && isfinite(s.y[i]);
+        px[i] = finite ? x_axis.map(x, left, right) : NAN;
+        py[i] = finite ? y_axis.map(s.y[i], bottom, top) : NAN;
+      }
+    });
+    if (s.style==STYLE_LINES || s.style==STYLE_LINESPOINTS) {
+      canvas.polyline(px.data(), py.data(), n, s.color, s.line_width);
+    }
+    if (s.style==STYLE_POINTS || s.style==STYLE_LINESPOINTS) {
+      canvas.marks(px.data(), py.data(), n, s.color, 3*s.point_size);
+    }
+    else if (s.style==STYLE_DOTS) {
+      canvas.marks(px.data(), py.data(), n, s.color, 0);
+    }
+  }
+  canvas.unclip();
+  
+  // key in the top right corner, as gnuplot places it
+  double key_y = top + ch;
+  for (const Series &s : _series) {
+    if (s.title.empty() || s.y.empty() || s.style==STYLE_IMAGE) {
+      continue;
+    }
+    double sample_left = right - 5*cw;
+    double sample_right = right - cw;
+    canvas.text(sample_left - cw, key_y, s.title, 1);
+    if (s.style==STYLE_LINES || s.style==STYLE_LINESPOINTS) {
+      double sample_x[2] = {sample_left, sample_right};
+      double sample_y[2] = {key_y, key_y};
+      canvas.polyline(sample_x, sample_y, 2, s.color, s.line_width);
+    }
+    else if (s.style==STYLE_BOXES) {
+      double sample_x[5] = {sample_left, sample_left, sample_right, sample_right, sample_left};
+      double sample_y[5] = {key_y + ch/3, key_y - ch/3, key_y - ch/3, key_y + ch/3, key_y + ch/3};
+      canvas.polyline(sample_x, sample_y, 5, s.color, s.line_width);
+    }
+    double mark_x = (sample_left + sample_right)/2;
+    if (s.style==STYLE_POINTS || s.style==STYLE_LINESPOINTS) {
+      canvas.marks(&mark_x, &key_y, 1, s.color, 3*s.point_size);
+    }
+    else if (s.style==STYLE_DOTS) {
+      canvas.marks(&mark_x, &key_y, 1, s.color, 0);
+    }
+    key_y += ch;
+  }
+}
+
+// Colours by the palette over the range of the values, the top row being
+// the last one of the grid.
+void Figure::_drawImage(Canvas &canvas,
+                        const Series &s,
+                        double left,
+                        double top,
+                        double right,
+                        double bottom) const {
+  double lo = INFINITY;
+  double hi = -INFINITY;
+  for (double value : s.y) {
+    if (isfinite(value)) {
+      lo = min(lo, value);
+      hi = max(hi, value);
+    }
+  }
+  double scale = (hi>lo) ? 1/(hi - lo) : 0;
+  vector<unsigned> colors(s.y.size());
+  parallel_for(0, s.ny, max(size_t(1), (1<<16)/max(s.nx, size_t(1))), [&](size_t begin, size_t end) {
+    for (size_t row=begin; row<end; row++) {
+      const double *values = &s.y[(s.ny - 1 - row)*s.nx];
+      unsigned *out = &colors[row*s.nx];
+      for (size_t column=0; column<s.nx; column++) {
+        // not a number shows as the background
+        out[column] = isfinite(values[column]) ? _heat((values[column] - lo)*scale) : 0xffffff;
+      }
+    }
+  });
+  canvas.image(left, top, right, bottom, s.nx, s.ny, colors.data());
+}
+
+} // tool
+
+} // otita
@@ -0,0 +1,126 @@
+//
+//  Figure.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _FIGURE_H_
+#define _FIGURE_H_
+
+#include <string>
+#include <vector>
+
+#include "Column.h"
+
+namespace otita {
+
+namespace tool {
+
+class Canvas;
+
+// A line and point plot rendered in-process to PNG, SVG or EPS, used by
+// GraphPlotter when gnuplot is not wanted or not available. Series options
+// take a subset of gnuplot's plot options: with lines, points, linespoints,
+// dots, boxes or image, linewidth, pointsize, linecolor (rgb '<name or
+// #rrggbb>' or a line type), linetype, title and notitle. Everything else is
+// ignored.
+class Figure {
+public:
+  Figure();
+  // Adds a series without points and returns its index.
+  size_t add(const ::std::string &options);
+  // Replaces the points of a series. x_begin==nullptr plots y against its
+  // index.
+  void set(size_t series,
+           const double *x_begin,
+           const double *y_begin,
+           size_t len);
+  void set(size_t series,
+           const Column *x,
+           const Column &y,
+           size_t len);
+  // Replaces a series by an nx by ny grid of values covering [x_lo, x_hi]
+  // by [y_lo, y_hi], values[iy*nx + ix] being the cell ix along x and iy
+  // along y. Drawn with image, coloured by gnuplot's default palette.
+  void setImage(size_t series,
+                size_t nx,
+                size_t ny,
+                double x_lo,
+                double x_hi,
+                double y_lo,
+                double y_hi,
+                const double *values);
+  size_t size() const;
+  // The values of a series as last set: x is empty for points plotted
+  // against their index and for images, whose grid is in y. Returns whether
+  // the series is an image, filling nx, ny and bounds if so.
+  bool values(size_t series,
+              const ::std::vector<double> *&x,
+              const ::std::vector<double> *&y,
+              size_t &nx,
+              size_t &ny,
+              double *bounds) const;
+  // The format follows the extension of filepath: .png, .svg, or .eps and
+  // .ps for EPS. Other extensions are refused.
+  bool write(const ::std::string &filepath) const;
+  virtual ~Figure();
+private:
+  enum style_t {
+    STYLE_LINES,
+    STYLE_POINTS,
+    STYLE_LINESPOINTS,
+    STYLE_DOTS,
+    STYLE_BOXES,
+    STYLE_IMAGE,
+  };
+  struct Series {
+    style_t style;
+    double line_width;
+    double point_size;
+    unsigned color;
+    ::std::string title;
+    ::std::vector<double> x;
+    ::std::vector<double> y;
+    // grid of an image, whose values are in y
+    size_t nx;
+    size_t ny;
+    double bounds[4];
+  };
+  ::std::vector<Series> _series;
+  void _draw(Canvas &canvas, double width, double height) const;
+  void _drawImage(Canvas &canvas,
+                  const Series &s,
+                  double left,
+                  double top,
+                  double right,
+                  double bottom) const;
+};
+
+} // tool
+
+} // otita
+
+#endif // _FIGURE_H_
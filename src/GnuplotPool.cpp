@@ -0,0 +1,351 @@
+//
+//  GnuplotPool.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <iostream>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cassert>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "GnuplotPool.h"
+
+#ifndef GNUPLOT
+#define GNUPLOT "gnuplot"
+#endif
+
+using namespace ::std;
+using namespace ::otita::tool;
+
+namespace otita {
+
+namespace tool {
+
+// One gnuplot child with stdin and stdout on pipes. print is sent to stdout,
+// where a marker line after each script tells that gnuplot has finished it.
+class GnuplotProcess {
+public:
+  GnuplotProcess();
+  virtual ~GnuplotProcess();
+  bool start();
+  bool run(const string &script);
+private:
+  pid_t _pid;
+  int _in;
+  int _out;
+  unsigned long _runs;
+  string _buffer;
+  void _stop();
+  bool _write(const string &data);
+  bool _readUntil(const string &marker);
+  GnuplotProcess(const GnuplotProcess &);
+  GnuplotProcess &operator=(const GnuplotProcess &);
+};
+
+// Pipes of one process must not leak into the others, or they would never
+// see end of file.
+static bool _pipe(int fds[2]) {
+#ifdef __linux__
+  return pipe2(fds, O_CLOEXEC)==0;
+#else
+  if (pipe(fds)!=0) {
+    return false;
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#endif
+}
+
+GnuplotProcess::GnuplotProcess() : _pid(-1), _in(-1), _out(-1), _runs(0) {
+}
+
+GnuplotProcess::~GnuplotProcess() {
+  _stop();
+}
+
+bool GnuplotProcess::start() {
+  if (_pid!=-1) {
+    return true;
+  }
+  int in[2];
+  int out[2];
+  if (!_pipe(in)) {
+    return false;
+  }
+  if (!_pipe(out)) {
+    close(in[0]);
+    close(in[1]);
+    return false;
+  }
+  string command = string("exec ") + GNUPLOT;
+  pid_t pid = fork();
+  if (pid==0) {
+    // the worker threads block SIGPIPE; gnuplot should not inherit that
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+    _exit(127);
+  }
+  close(in[0]);
+  close(out[1]);
+  if (pid<0) {
+    close(in[1]);
+    close(out[0]);
+    return false;
+  }
+  _pid = pid;
+  _in = in[1];
+  _out = out[0];
+  _buffer.clear();
+  return _write("set print '-'\n");
+}
+
+bool GnuplotProcess::run(const string &script) {
+  if (!start()) {
+    cerr << "cannot start gnuplot" << endl;
+    return false;
+  }
+  string marker = "gnuplot_pool_done " + to_string(++_runs);
+  // set output closes the figure before the marker is printed
+  if (!_write("reset\n" + script + "\nset output\nprint '" + marker + "'\n") ||
+      !_readUntil(marker + "\n")) {
+    cerr << "gnuplot exited while rendering" << endl;
+    _stop();
+    return false;
+  }
+  return true;
+}
+
+// Closing stdin makes gnuplot exit.
+void GnuplotProcess::_stop() {
+  if (_pid==-1) {
+    return;
+  }
+  close(_in);
+  close(_out);
+  int status;
+  while (waitpid(_pid, &status, 0)<0 && errno==EINTR) {
+  }
+  _pid = -1;
+  _in = -1;
+  _out = -1;
+}
+
+bool GnuplotProcess::_write(const string &data) {
+  const char *p = data.data();
+  size_t size = data.size();
+  while (size>0) {
+    ssize_t n = write(_in, p, size);
+    if (n<0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+bool GnuplotProcess::_readUntil(const string &marker) {
+  for (;;) {
+    size_t pos = _buffer.find(marker);
+    if (pos!=string::npos) {
+      _buffer.erase(0, pos + marker.size());
+      return true;
+    }
+    if (_buffer.size()>marker.size()) {
+      _buffer.erase(0, _buffer.size() - marker.size());
+    }
+    char buf[4096];
+    ssize_t n = read(_out, buf, sizeof(buf));
+    if (n<0 && errno==EINTR) {
+      continue;
+    }
+    if (n<=0) {
+      return false;
+    }
+    _buffer.append(buf, size_t(n));
+  }
+}
+
+class GnuplotPool::Impl {
+public:
+  Impl(size_t workers);
+  void submit(const string &script, const function<void()> &done);
+  void wait();
+  size_t workers() const;
+  virtual ~Impl();
+  // GraphPlotters that hold a pointer to the pool
+  atomic<size_t> borrowers;
+private:
+  struct Job {
+    string script;
+    function<void()> done;
+  };
+  deque<Job> _queue;
+  // submitted scripts that have not finished
+  size_t _pending;
+  bool _stop;
+  mutex _mutex;
+  condition_variable _ready;
+  condition_variable _idle;
+  vector<thread> _workers;
+  void _run();
+};
+
+GnuplotPool::Impl::Impl(size_t workers)
+  : borrowers(0), _pending(0), _stop(false) {
+  if (workers==0) {
+    workers = max(thread::hardware_concurrency(), 1u);
+  }
+  for (size_t i=0; i<workers; i++) {
+    _workers.emplace_back(&Impl::_run, this);
+  }
+}
+
+void GnuplotPool::Impl::submit(const string &script,
+                               const function<void()> &done) {
+  {
+    lock_guard<mutex> lock(_mutex);
+    Job job;
+    job.script = script;
+    job.done = done;
+    _queue.push_back(move(job));
+    _pending++;
+  }
+  _ready.notify_one();
+}
+
+void GnuplotPool::Impl::wait() {
+  unique_lock<mutex> lock(_mutex);
+  _idle.wait(lock, [this]() {
+    return _pending==0;
+  });
+}
+
+size_t GnuplotPool::Impl::workers() const {
+  return _workers.size();
+}
+
+GnuplotPool::Impl::~Impl() {
+  if (borrowers.load()!=0) {
+    cerr << "gnuplot pool destroyed before " << borrowers.load()
+         << " of its plotters" << endl;
+    assert(borrowers.load()==0);
+  }
+  {
+    lock_guard<mutex> lock(_mutex);
+    _stop = true;
+  }
+  _ready.notify_all();
+  for (thread &worker : _workers) {
+    worker.join();
+  }
+}
+
+void GnuplotPool::Impl::_run() {
+  // a dead gnuplot should fail the write, not kill the process
+  sigset_t pipe_signal;
+  sigemptyset(&pipe_signal);
+  sigaddset(&pipe_signal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_signal, nullptr);
+  
+  GnuplotProcess process;
+  if (!process.start()) {
+    cerr << "cannot start gnuplot" << endl;
+  }
+  unique_lock<mutex> lock(_mutex);
+  for (;;) {
+    _ready.wait(lock, [this]() {
+      return _stop || !_queue.empty();
+    });
+    if (_queue.empty()) {
+      break;
+    }
+    Job job = move(_queue.front());
+    _queue.pop_front();
+    lock.unlock();
+    process.run(job.script);
+    if (job.done) {
+      job.done();
+    }
+    job.done = nullptr;
+    lock.lock();
+    if (--_pending==0) {
+      _idle.notify_all();
+    }
+  }
+}
+
+GnuplotPool::GnuplotPool(size_t workers) {
+  _impl = new Impl(workers);
+}
+
+void GnuplotPool::submit(const string &script, const function<void()> &done) {
+  _impl->submit(script, done);
+}
+
+void GnuplotPool::wait() {
+  _impl->wait();
+}
+
+size_t GnuplotPool::workers() const {
+  return _impl->workers();
+}
+
+void GnuplotPool::_borrow() {
+  _impl->borrowers++;
+}
+
+void GnuplotPool::_release() {
+  _impl->borrowers--;
+}
+
+GnuplotPool::~GnuplotPool() {
+  delete _impl;
+}
+
+} // tool
+
+} // otita
@@ -0,0 +1,72 @@
+//
+//  GnuplotPool.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _GNUPLOT_POOL_H_
+#define _GNUPLOT_POOL_H_
+
+#include <string>
+#include <functional>
+
+namespace otita {
+
+namespace tool {
+
+// Persistent gnuplot processes that render figures one after another, so a
+// batch pays for process startup once per worker rather than per figure.
+// See GraphPlotter(GnuplotPool &, const std::string &). A pool must outlive
+// the plotters that render on it.
+class GnuplotPool {
+public:
+  // workers==0 starts one process per hardware thread.
+  GnuplotPool(size_t workers=0);
+  // Runs script on the next idle process after a reset. done is called on a
+  // worker thread once gnuplot has finished the script.
+  void submit(const ::std::string &script,
+              const ::std::function<void()> &done=::std::function<void()>());
+  // Blocks until every submitted script has finished.
+  void wait();
+  size_t workers() const;
+  // Finishes the queued scripts, then stops the processes.
+  virtual ~GnuplotPool();
+private:
+  friend class GraphPlotter;
+  class Impl;
+  Impl *_impl;
+  // counts the plotters that will submit their figure to the pool
+  void _borrow();
+  void _release();
+  GnuplotPool(const GnuplotPool &);
+  GnuplotPool &operator=(const GnuplotPool &);
+};
+
+} // tool
+
+} // otita
+
+#endif // _GNUPLOT_POOL_H_
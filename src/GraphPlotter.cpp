@@ -24,9 +24,31 @@ THE SOFTWARE.
 */
 
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include "GraphPlotter.h"
+#include "GnuplotPool.h"
+#include "Figure.h"
+#include "decimate.h"
+#include "binning.h"
 
 using namespace ::std;
 using namespace ::otita::tool;
@@ -34,138 +56,977 @@ using namespace ::otita::tool;
 namespace otita {
 
 namespace tool {
+
+// Holds one series for gnuplot to read by path. On Linux this is an anonymous
+// memfd that gnuplot opens through /proc, so no copy reaches the disk;
+// elsewhere a mkstemp file. Either is released by the destructor, which runs
+// once gnuplot has exited.
+class DataFile {
+public:
+  DataFile();
+  virtual ~DataFile();
+  bool is_open() const;
+  const string &path() const;
+  bool write(const Column *x,
+             const Column &y,
+             size_t len);
+private:
+  int _fd;
+  string _path;
+  bool _unlink;
+  bool _write(const void *buf, size_t size);
+  DataFile(const DataFile &);
+  DataFile &operator=(const DataFile &);
+};
+
+DataFile::DataFile() : _fd(-1), _unlink(false) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+  _fd = memfd_create("gnuplot_data", MFD_CLOEXEC);
+  if (_fd!=-1) {
+    _path = "/proc/" + to_string(getpid()) + "/fd/" + to_string(_fd);
+    return;
+  }
+#endif
+  char tmp_filename[] = "/var/tmp/gnuplot_tmpdatafile_XXXXXX";
+  _fd = mkstemp(tmp_filename);
+  if (_fd!=-1) {
+    _path = tmp_filename;
+    _unlink = true;
+  }
+}
+
+DataFile::~DataFile() {
+  if (_fd!=-1) {
+    close(_fd);
+  }
+  if (_unlink) {
+    unlink(_path.c_str());
+  }
+}
+
+bool DataFile::is_open() const {
+  return _fd!=-1;
+}
+
+const string &DataFile::path() const {
+  return _path;
+}
+
+// Writes the series as raw native doubles for gnuplot's binary format. A
+// single column (x==nullptr) of doubles goes out in one write; anything else
+// is converted, and x/y pairs interleaved, through a small buffer since
+// gnuplot reads binary columns record by record.
+bool DataFile::write(const Column *x,
+                     const Column &y,
+                     size_t len) {
+  if (x==nullptr && y.doubles()!=nullptr) {
+    return _write(y.doubles(), len*sizeof(double));
+  }
+  static const size_t chunk = 4096;
+  double buf[2*chunk];
+  double x_chunk[chunk];
+  for (size_t i=0; i<len; i+=chunk) {
+    size_t n = min(chunk, len-i);
+    if (x==nullptr) {
+      y.read(i, n, buf);
+      if (!_write(buf, n*sizeof(double))) {
+        return false;
+      }
+      continue;
+    }
+    x->read(i, n, x_chunk);
+    y.read(i, n, buf + chunk);
+    for (size_t j=0; j<n; j++) {
+      buf[2*j] = x_chunk[j];
+      buf[2*j+1] = buf[chunk+j];
+    }
+    if (!_write(buf, 2*n*sizeof(double))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DataFile::_write(const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size>0) {
+    ssize_t n = ::write(_fd, p, size);
+    if (n<0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+// Single-producer ring holding the recent points of a stream, sized to twice
+// the window so that the renderer can copy a window while the producer keeps
+// appending. Slots are relaxed atomics and the append count is published with
+// release; the renderer drops any slot overwritten during its copy.
+class GraphPlotter::StreamRing {
+public:
+  StreamRing(size_t window, const string &options);
+  void append(double x, double y);
+  uint64_t head() const;
+  uint64_t read(vector<double> &x, vector<double> &y) const;
+  const string &options() const;
+  // append count at the last redraw; owned by the renderer
+  uint64_t rendered;
+  // index in the figure of the native backend
+  size_t series;
+private:
+  size_t _window;
+  size_t _mask;
+  unique_ptr<atomic<double>[]> _x;
+  unique_ptr<atomic<double>[]> _y;
+  atomic<uint64_t> _head;
+  string _options;
+  StreamRing(const StreamRing &);
+  StreamRing &operator=(const StreamRing &);
+};
+
+GraphPlotter::StreamRing::StreamRing(size_t window, const string &options)
+  : rendered(0), series(0), _window(max(window, size_t(1))), _head(0), _options(options) {
+  size_t capacity = 1;
+  while (capacity<2*_window) {
+    capacity <<= 1;
+  }
+  _mask = capacity - 1;
+  _x.reset(new atomic<double>[capacity]);
+  _y.reset(new atomic<double>[capacity]);
+}
+
+void GraphPlotter::StreamRing::append(double x, double y) {
+  uint64_t head = _head.load(memory_order_relaxed);
+  // a reader that sees these stores also sees the previous append count
+  atomic_thread_fence(memory_order_release);
+  _x[head & _mask].store(x, memory_order_relaxed);
+  _y[head & _mask].store(y, memory_order_relaxed);
+  _head.store(head + 1, memory_order_release);
+}
+
+uint64_t GraphPlotter::StreamRing::head() const {
+  return _head.load(memory_order_acquire);
+}
+
+// Copies the latest window points and returns the append count they end at.
+uint64_t GraphPlotter::StreamRing::read(vector<double> &x,
+                                        vector<double> &y) const {
+  uint64_t head = _head.load(memory_order_acquire);
+  uint64_t begin = (head>_window) ? head - _window : 0;
+  x.resize(size_t(head - begin));
+  y.resize(size_t(head - begin));
+  for (uint64_t i=begin; i<head; i++) {
+    x[size_t(i - begin)] = _x[i & _mask].load(memory_order_relaxed);
+    y[size_t(i - begin)] = _y[i & _mask].load(memory_order_relaxed);
+  }
+  atomic_thread_fence(memory_order_acquire);
+  // slot i is rewritten once the append count reaches i + capacity
+  uint64_t now = _head.load(memory_order_relaxed);
+  uint64_t capacity = _mask + 1;
+  if (now>=begin+capacity) {
+    size_t lost = size_t(min(now - (begin + capacity) + 1, head - begin));
+    x.erase(x.begin(), x.begin() + lost);
+    y.erase(y.begin(), y.begin() + lost);
+  }
+  return head;
+}
+
+const string &GraphPlotter::StreamRing::options() const {
+  return _options;
+}
   
 class GraphPlotter::Impl {
 public:
   Impl();
-  Impl(const string &filepath);
+  Impl(const string &filepath, backend_t backend);
+  Impl(GnuplotPool &pool, const string &filepath);
   void plot(const string &equation);
-  void plot(const double *x_begin,
-            size_t len,
-            const string &options);
-  void plot(const double *x_begin,
-            const double *y_begin,
+  void plot(const Column *x,
+            const Column &y,
             size_t len,
-            const string &options);
+            const string &options,
+            const string &key);
+  void histogram(const Column &data,
+                 size_t len,
+                 size_t bins,
+                 const string &options);
+  void heatmap(const Column &x,
+               const Column &y,
+               size_t len,
+               size_t nx,
+               size_t ny,
+               const string &options);
+  void decimate(decimation_t method, size_t max_points);
+  shared_ptr<StreamRing> stream(size_t window, const string &options);
+  void refresh_rate(double fps);
+  void async(size_t queue_size, backpressure_t policy);
+  future<void> flush();
+  size_t dropped();
   virtual ~Impl();
 private:
-  const char *_tmpName();
+  // Work queued for the async writer.
+  struct Job {
+    enum kind_t {
+      EQUATION,
+      SERIES,
+      IMAGE,
+      FLUSH,
+    };
+    kind_t kind;
+    string options;
+    // update() key of a series, empty for plot()
+    string key;
+    bool has_x;
+    vector<double> x;
+    vector<double> y;
+    decimation_t decimation;
+    size_t max_points;
+    // grid of an image, whose values are in y
+    size_t nx;
+    size_t ny;
+    double bounds[4];
+    promise<void> done;
+    Job(kind_t kind)
+      : kind(kind), has_x(false), decimation(DECIMATION_NONE), max_points(0),
+        nx(0), ny(0) {}
+  };
+  const DataFile *_data(const Column *x,
+                        const Column &y,
+                        size_t len);
+  void _plot(const Column *x,
+             const Column &y,
+             size_t len,
+             const string &options,
+             decimation_t decimation,
+             size_t max_points);
+  void _image(size_t nx,
+              size_t ny,
+              const double *bounds,
+              const vector<double> &values,
+              const string &options);
+  string _seriesTerm(const Column *x,
+                     const Column &y,
+                     size_t len,
+                     const string &options);
+  string _imageTerm(size_t nx,
+                    size_t ny,
+                    const double *bounds,
+                    const vector<double> &values,
+                    const string &style);
+  void _toGnuplot();
+  void _enqueue(unique_lock<mutex> &lock, Job &job);
+  void _init();
+  void _write();
+  void _equation(const string &equation);
+  void _addTerm(const string &term);
+  void _run();
+  void _render();
+  // With a pool, commands collect in a memory stream that becomes the
+  // script of the figure.
   FILE *_gnuplot_p;
-  bool _plotted_any;
+  GnuplotPool *_pool;
+  char *_script;
+  size_t _script_size;
+  vector<unique_ptr<DataFile> > _data_files;
+  // output file of gnuplot, set again before every frame so that a redraw
+  // replaces the figure instead of adding a page
+  string _filepath;
+  // The native backend draws _figure to _output instead, if there is one.
+  unique_ptr<Figure> _figure;
+  string _output;
+  // BACKEND_AUTO chose the native backend although gnuplot is available;
+  // the first equation hands the figure over to gnuplot.
+  bool _auto_native;
+  // options of each series of _figure, to plot them again with gnuplot
+  vector<string> _series_options;
+  decimation_t _decimation;
+  size_t _max_points;
+  // Plot terms added through plot(). Only the renderer writes to the pipe
+  // once streaming has started, so _mutex guards the terms and the streams.
+  string _terms;
+  string _sent;
+  vector<shared_ptr<StreamRing> > _streams;
+  double _fps;
+  bool _stop;
+  mutex _mutex;
+  condition_variable _wakeup;
+  thread _renderer;
+  // async mode, guarded by _mutex
+  bool _async;
+  size_t _queue_size;
+  backpressure_t _policy;
+  size_t _dropped;
+  deque<Job> _queue;
+  // jobs in _queue other than flush barriers
+  size_t _queued;
+  condition_variable _queue_ready;
+  condition_variable _queue_space;
+  thread _writer;
+  // held while writing to the pipe or the figure
+  mutex _pipe_mutex;
 };
   
+static const char _eps_terminal[] = "set terminal postscript;\
+                                  set term postscript eps enhanced color\n";
+  
+#ifdef GNUPLOT
+static string _extension(const string &filepath) {
+  size_t dot = filepath.rfind('.');
+  if (dot==string::npos || filepath.find('/', dot)!=string::npos) {
+    return "";
+  }
+  string extension = filepath.substr(dot);
+  transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  return extension;
+}
+#endif
+  
+// Whether options pick a style themselves, with "with" or an abbreviation
+// of it outside quotes.
+static bool _hasStyle(const string &options) {
+  size_t i = 0;
+  while (i<options.size()) {
+    char c = options[i];
+    if (c=='\'' || c=='"') {
+      size_t end = options.find(c, i+1);
+      i = (end==string::npos) ? options.size() : end + 1;
+      continue;
+    }
+    if (!isalpha(static_cast<unsigned char>(c))) {
+      i++;
+      continue;
+    }
+    size_t end = i;
+    while (end<options.size() && isalnum(static_cast<unsigned char>(options[end]))) {
+      end++;
+    }
+    string word = options.substr(i, end - i);
+    transform(word.begin(), word.end(), word.begin(), ::tolower);
+    if (string("with").compare(0, word.size(), word)==0) {
+      return true;
+    }
+    i = end;
+  }
+  return false;
+}
+  
 GraphPlotter::Impl::Impl() {
+  _init();
+#ifdef GNUPLOT
   string gnuplot = GNUPLOT;
   gnuplot = gnuplot + " -persist";
   _gnuplot_p = popen(gnuplot.c_str(), "w");
-  fprintf(_gnuplot_p, "plot ");
-  _plotted_any = false;
+#else
+  cerr << "built without gnuplot, nothing will be displayed" << endl;
+  _figure.reset(new Figure());
+#endif
 }
              
-GraphPlotter::Impl::Impl(const string &filepath) {
-  static const char cmd_format[] = "set terminal postscript;\
-                                    set term postscript eps enhanced color;\
-                                    set output '%s';\
-                                    plot ";
+GraphPlotter::Impl::Impl(const string &filepath, backend_t backend) {
+  _init();
+#ifdef GNUPLOT
+  string extension = _extension(filepath);
+  bool native = (backend==BACKEND_NATIVE) ||
+                (backend==BACKEND_AUTO && (extension==".png" || extension==".svg"));
+  _auto_native = native && backend==BACKEND_AUTO;
+#else
+  if (backend==BACKEND_GNUPLOT) {
+    cerr << "built without gnuplot, drawing " << filepath << " natively" << endl;
+  }
+  bool native = true;
+#endif
+  if (native) {
+    _figure.reset(new Figure());
+    _output = filepath;
+    return;
+  }
+#ifdef GNUPLOT
   _gnuplot_p = popen(GNUPLOT, "w");
-  fprintf(_gnuplot_p, cmd_format, filepath.c_str());
-  _plotted_any = false;
+  fputs(_eps_terminal, _gnuplot_p);
+  _filepath = filepath;
+#endif
+}
+
+GraphPlotter::Impl::Impl(GnuplotPool &pool, const string &filepath) {
+  _init();
+  _gnuplot_p = open_memstream(&_script, &_script_size);
+  _pool = &pool;
+  _pool->_borrow();
+  fputs(_eps_terminal, _gnuplot_p);
+  _filepath = filepath;
 }
   
 void GraphPlotter::Impl::plot(const string &equation) {
-  if (_plotted_any) {
-    fputs((", " + equation).c_str(), _gnuplot_p);
-  }
-  else {
-    fputs(equation.c_str(), _gnuplot_p);
-    _plotted_any = true;
+  unique_lock<mutex> lock(_mutex);
+  if (_async) {
+    Job job(Job::EQUATION);
+    job.options = equation;
+    _enqueue(lock, job);
+    return;
   }
+  lock.unlock();
+  _equation(equation);
 }
   
-void GraphPlotter::Impl::plot(const double *x_begin,
+void GraphPlotter::Impl::plot(const Column *x,
+                              const Column &y,
                               size_t len,
-                              const string &options) {
-  const char *tmp_name = _tmpName();
-  if (tmp_name==nullptr) {
-    cerr << "cannot get tmp name" << endl;
+                              const string &options,
+                              const string &key) {
+  unique_lock<mutex> lock(_mutex);
+  if (_async) {
+    // the caller may reuse its buffers once plot() returns; the copy is
+    // made without the lock, which the writer and the renderer need
+    lock.unlock();
+    Job job(Job::SERIES);
+    job.options = options;
+    job.key = key;
+    job.has_x = (x!=nullptr);
+    if (job.has_x) {
+      job.x.resize(len);
+      x->read(0, len, job.x.data());
+    }
+    job.y.resize(len);
+    y.read(0, len, job.y.data());
+    job.decimation = _decimation;
+    job.max_points = _max_points;
+    lock.lock();
+    if (_async) {
+      _enqueue(lock, job);
+      return;
+    }
+  }
+  lock.unlock();
+  _plot(x, y, len, options, _decimation, _max_points);
+}
+
+// Bins are never decimated.
+void GraphPlotter::Impl::histogram(const Column &data,
+                                   size_t len,
+                                   size_t bins,
+                                   const string &options) {
+  double lo;
+  double hi;
+  vector<double> counts;
+  bin_1d(data, len, bins, lo, hi, counts);
+  vector<double> centres(counts.size());
+  for (size_t k=0; k<centres.size(); k++) {
+    // interpolated, since hi - lo may overflow
+    double f = (double(k) + 0.5)/double(counts.size());
+    centres[k] = lo*(1 - f) + hi*f;
+  }
+  string style = _hasStyle(options) ? options : "with boxes " + options;
+  unique_lock<mutex> lock(_mutex);
+  if (!_async) {
+    lock.unlock();
+    Column x(centres.data());
+    _plot(&x, Column(counts.data()), counts.size(), style, DECIMATION_NONE, 0);
     return;
   }
-  ofstream tmpstream(tmp_name);
-  if (!tmpstream.is_open()) {
-    cerr << "cannot open tmp file" << endl;
+  Job job(Job::SERIES);
+  job.options = style;
+  job.has_x = true;
+  job.x = move(centres);
+  job.y = move(counts);
+  _enqueue(lock, job);
+}
+
+void GraphPlotter::Impl::heatmap(const Column &x,
+                                 const Column &y,
+                                 size_t len,
+                                 size_t nx,
+                                 size_t ny,
+                                 const string &options) {
+  double bounds[4];
+  vector<double> counts;
+  bin_2d(x, y, len, nx, ny, bounds[0], bounds[1], bounds[2], bounds[3], counts);
+  nx = max(nx, size_t(1));
+  ny = max(ny, size_t(1));
+  unique_lock<mutex> lock(_mutex);
+  if (!_async) {
+    lock.unlock();
+    _image(nx, ny, bounds, counts, options);
     return;
   }
-  for (size_t i=0; i<len; i++) {
-    tmpstream << *(x_begin+i) << endl;
+  Job job(Job::IMAGE);
+  job.options = options;
+  job.y = move(counts);
+  job.nx = nx;
+  job.ny = ny;
+  copy(bounds, bounds + 4, job.bounds);
+  _enqueue(lock, job);
+}
+
+void GraphPlotter::Impl::decimate(decimation_t method, size_t max_points) {
+  _decimation = method;
+  _max_points = max_points;
+}
+
+shared_ptr<GraphPlotter::StreamRing> GraphPlotter::Impl::stream(size_t window,
+                                                                const string &options) {
+  shared_ptr<StreamRing> stream(new StreamRing(window, options));
+  {
+    lock_guard<mutex> pipe_lock(_pipe_mutex);
+    if (_figure) {
+      stream->series = _figure->add(options);
+      _series_options.push_back(options);
+    }
+  }
+  lock_guard<mutex> lock(_mutex);
+  _streams.push_back(stream);
+  if (!_renderer.joinable()) {
+    _renderer = thread(&Impl::_run, this);
   }
+  return stream;
+}
+
+void GraphPlotter::Impl::refresh_rate(double fps) {
+  lock_guard<mutex> lock(_mutex);
+  _fps = (fps>0) ? fps : 30;
+}
+
+void GraphPlotter::Impl::async(size_t queue_size, backpressure_t policy) {
+  lock_guard<mutex> lock(_mutex);
+  _async = true;
+  _queue_size = max(queue_size, size_t(1));
+  _policy = policy;
+  if (!_writer.joinable()) {
+    _writer = thread(&Impl::_write, this);
+  }
+  _queue_space.notify_all();
+}
+
+future<void> GraphPlotter::Impl::flush() {
+  unique_lock<mutex> lock(_mutex);
+  if (_async) {
+    Job job(Job::FLUSH);
+    future<void> done = job.done.get_future();
+    _enqueue(lock, job);
+    return done;
+  }
+  lock.unlock();
+  _render();
+  promise<void> done;
+  done.set_value();
+  return done.get_future();
+}
+
+size_t GraphPlotter::Impl::dropped() {
+  lock_guard<mutex> lock(_mutex);
+  return _dropped;
+}
+
+GraphPlotter::Impl::~Impl() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wakeup.notify_all();
+  _queue_ready.notify_all();
+  // the writer drains the queue before it exits
+  if (_writer.joinable()) {
+    _writer.join();
+  }
+  if (_renderer.joinable()) {
+    _renderer.join();
+  }
+  _render();
+  if (_figure) {
+    return;
+  }
+  if (_pool!=nullptr) {
+    fclose(_gnuplot_p);
+    string script(_script, _script_size);
+    free(_script);
+    // the data files live until the pool has rendered the figure
+    shared_ptr<vector<unique_ptr<DataFile> > > data_files(
+      new vector<unique_ptr<DataFile> >(move(_data_files)));
+    _pool->submit(script, [data_files]() {
+      data_files->clear();
+    });
+    _pool->_release();
+    return;
+  }
+  pclose(_gnuplot_p);
+  // gnuplot has read everything by now
+  _data_files.clear();
+}
   
-  if (_plotted_any) {
-    fprintf(_gnuplot_p, ", '%s' %s",
-            tmp_name,
-            options.c_str());
+const DataFile *GraphPlotter::Impl::_data(const Column *x,
+                                          const Column &y,
+                                          size_t len) {
+  unique_ptr<DataFile> data(new DataFile());
+  if (!data->is_open()) {
+    cerr << "cannot create data file" << endl;
+    return nullptr;
   }
-  else {
-    fprintf(_gnuplot_p, "'%s' %s",
-            tmp_name,
-            options.c_str());
-    _plotted_any = true;
+  if (!data->write(x, y, len)) {
+    cerr << "cannot write data file" << endl;
+    return nullptr;
+  }
+  _data_files.push_back(move(data));
+  return _data_files.back().get();
+}
+  
+// x==nullptr plots y against its index. Series longer than the decimation
+// limit are reduced first, keeping the index as x.
+void GraphPlotter::Impl::_plot(const Column *x,
+                               const Column &y,
+                               size_t len,
+                               const string &options,
+                               decimation_t decimation,
+                               size_t max_points) {
+  vector<double> x_out;
+  vector<double> y_out;
+  Column x_reduced;
+  Column y_reduced;
+  const Column *y_values = &y;
+  if (decimation!=DECIMATION_NONE && len>max_points) {
+    if (decimation==DECIMATION_LTTB) {
+      decimate_lttb(x, y, len, max_points, x_out, y_out);
+    }
+    else {
+      decimate_minmax(x, y, len, max_points, x_out, y_out);
+    }
+    x_reduced = Column(x_out.data());
+    y_reduced = Column(y_out.data());
+    x = &x_reduced;
+    y_values = &y_reduced;
+    len = x_out.size();
+  }
+  
+  if (_figure) {
+    size_t series;
+    {
+      lock_guard<mutex> pipe_lock(_pipe_mutex);
+      series = _figure->add(options);
+      _figure->set(series, x, *y_values, len);
+      _series_options.push_back(options);
+    }
+    // stands in for the series in the command that decides when to redraw
+    _addTerm("series " + to_string(series));
+    return;
+  }
+  string term = _seriesTerm(x, *y_values, len, options);
+  if (!term.empty()) {
+    _addTerm(term);
   }
 }
 
-void GraphPlotter::Impl::plot(const double *x_begin,
-                              const double *y_begin,
-                              size_t len,
-                              const string &options) {
-  const char *tmp_name = _tmpName();
-  if (tmp_name==nullptr) {
-    cerr << "cannot get tmp name" << endl;
+// Writes the series to a data file and returns its plot term, or an empty
+// string on failure.
+string GraphPlotter::Impl::_seriesTerm(const Column *x,
+                                       const Column &y,
+                                       size_t len,
+                                       const string &options) {
+  const DataFile *data = _data(x, y, len);
+  if (data==nullptr) {
+    return "";
+  }
+  const char *format = (x==nullptr)
+                     ? "binary format='%double' using 1"
+                     : "binary format='%double%double' using 1:2";
+  return "'" + data->path() + "' " + format + " " + options;
+}
+
+// bounds are x_lo, x_hi, y_lo and y_hi; values go along x first.
+void GraphPlotter::Impl::_image(size_t nx,
+                                size_t ny,
+                                const double *bounds,
+                                const vector<double> &values,
+                                const string &options) {
+  string style = _hasStyle(options) ? options : "with image " + options;
+  if (_figure) {
+    size_t series;
+    {
+      lock_guard<mutex> pipe_lock(_pipe_mutex);
+      series = _figure->add(style);
+      _figure->setImage(series, nx, ny, bounds[0], bounds[1], bounds[2], bounds[3],
+                        values.data());
+      _series_options.push_back(style);
+    }
+    _addTerm("series " + to_string(series));
     return;
   }
-  ofstream tmpstream(tmp_name);
-  if (!tmpstream.is_open()) {
-    cerr << "cannot open tmp file" << endl;
+  string term = _imageTerm(nx, ny, bounds, values, style);
+  if (!term.empty()) {
+    _addTerm(term);
+  }
+}
+
+string GraphPlotter::Impl::_imageTerm(size_t nx,
+                                      size_t ny,
+                                      const double *bounds,
+                                      const vector<double> &values,
+                                      const string &style) {
+  const DataFile *data = _data(nullptr, Column(values.data()), values.size());
+  if (data==nullptr) {
+    return "";
+  }
+  double dx = (bounds[1] - bounds[0])/double(nx);
+  double dy = (bounds[3] - bounds[2])/double(ny);
+  // origin is the centre of the first cell
+  char format[256];
+  snprintf(format, sizeof(format),
+           "binary array=(%lu,%lu) dx=%.17g dy=%.17g origin=(%.17g,%.17g) format='%%double'",
+           (unsigned long)nx, (unsigned long)ny, dx, dy,
+           bounds[0] + dx/2, bounds[2] + dy/2);
+  return "'" + data->path() + "' " + format + " " + style;
+}
+
+// Flush barriers are never dropped and do not count against the queue size.
+// A coalesced series takes the place of the one it replaces, which must not
+// be behind a barrier.
+void GraphPlotter::Impl::_enqueue(unique_lock<mutex> &lock, Job &job) {
+  if (job.kind!=Job::FLUSH) {
+    if (_queued>=_queue_size && _policy==BACKPRESSURE_COALESCE && !job.key.empty()) {
+      for (deque<Job>::reverse_iterator it=_queue.rbegin(); it!=_queue.rend(); ++it) {
+        if (it->kind==Job::FLUSH) {
+          break;
+        }
+        if (it->key==job.key) {
+          *it = move(job);
+          _dropped++;
+          return;
+        }
+      }
+    }
+    if (_policy==BACKPRESSURE_DROP_OLDEST) {
+      deque<Job>::iterator it = _queue.begin();
+      while (_queued>=_queue_size && it!=_queue.end()) {
+        if (it->kind==Job::FLUSH) {
+          ++it;
+          continue;
+        }
+        it = _queue.erase(it);
+        _queued--;
+        _dropped++;
+      }
+    }
+    _queue_space.wait(lock, [this]() {
+      return _queued<_queue_size;
+    });
+    _queued++;
+  }
+  _queue.push_back(move(job));
+  _queue_ready.notify_one();
+}
+
+void GraphPlotter::Impl::_write() {
+  unique_lock<mutex> lock(_mutex);
+  for (;;) {
+    _queue_ready.wait(lock, [this]() {
+      return _stop || !_queue.empty();
+    });
+    if (_queue.empty()) {
+      break;
+    }
+    Job job = move(_queue.front());
+    _queue.pop_front();
+    if (job.kind!=Job::FLUSH) {
+      _queued--;
+      _queue_space.notify_all();
+    }
+    lock.unlock();
+    if (job.kind==Job::EQUATION) {
+      _equation(job.options);
+    }
+    else if (job.kind==Job::SERIES) {
+      Column x(job.x.data());
+      _plot(job.has_x ? &x : nullptr,
+            Column(job.y.data()),
+            job.y.size(),
+            job.options,
+            job.decimation,
+            job.max_points);
+    }
+    else if (job.kind==Job::IMAGE) {
+      _image(job.nx, job.ny, job.bounds, job.y, job.options);
+    }
+    else {
+      _render();
+      job.done.set_value();
+    }
+    lock.lock();
+  }
+}
+
+void GraphPlotter::Impl::_init() {
+  _gnuplot_p = nullptr;
+  _pool = nullptr;
+  _script = nullptr;
+  _script_size = 0;
+  _decimation = DECIMATION_NONE;
+  _max_points = 0;
+  _fps = 30;
+  _stop = false;
+  _async = false;
+  _queue_size = 0;
+  _policy = BACKPRESSURE_BLOCK;
+  _dropped = 0;
+  _queued = 0;
+  _auto_native = false;
+}
+
+void GraphPlotter::Impl::_equation(const string &equation) {
+  if (_figure && _auto_native) {
+    _toGnuplot();
+  }
+  if (_figure) {
+    cerr << "equations need gnuplot: " << equation << endl;
     return;
   }
-  for (size_t i=0; i<len; i++) {
-    tmpstream << *(x_begin+i) << ' ' << *(y_begin+i) << endl;
+  _addTerm(equation);
+}
+
+// Draws the figure with gnuplot from now on, to the same file with the
+// terminal for its extension. Until the first equation the terms are all
+// figure series, which are written to data files.
+void GraphPlotter::Impl::_toGnuplot() {
+#ifdef GNUPLOT
+  lock_guard<mutex> pipe_lock(_pipe_mutex);
+  if (!_figure) {
+    return;
+  }
+  FILE *gnuplot_p = popen(GNUPLOT, "w");
+  if (gnuplot_p==nullptr) {
+    cerr << "cannot start gnuplot" << endl;
+    return;
   }
-  if (_plotted_any) {
-    fprintf(_gnuplot_p, ", '%s' using 1:2 %s",
-            tmp_name,
-            options.c_str());
+  const char *terminal = (_extension(_output)==".svg") ? "svg" : "png";
+  fprintf(gnuplot_p, "set terminal %s size 640,480\n", terminal);
+  string terms;
+  {
+    lock_guard<mutex> lock(_mutex);
+    terms = _terms;
   }
-  else {
-    fprintf(_gnuplot_p, "'%s' using 1:2 %s",
-            tmp_name,
-            options.c_str());
-    _plotted_any = true;
+  string command;
+  size_t begin = 0;
+  while (begin<terms.size()) {
+    size_t end = min(terms.find(", ", begin), terms.size());
+    size_t series = size_t(strtoul(terms.c_str() + begin + strlen("series "), nullptr, 10));
+    const vector<double> *x;
+    const vector<double> *y;
+    size_t nx;
+    size_t ny;
+    double bounds[4];
+    string term;
+    if (_figure->values(series, x, y, nx, ny, bounds)) {
+      term = _imageTerm(nx, ny, bounds, *y, _series_options[series]);
+    }
+    else {
+      Column x_values(x->data());
+      term = _seriesTerm(x->empty() ? nullptr : &x_values, Column(y->data()), y->size(),
+                         _series_options[series]);
+    }
+    if (!term.empty()) {
+      command += (command.empty() ? "" : ", ") + term;
+    }
+    begin = end + 2;
+  }
+  lock_guard<mutex> lock(_mutex);
+  _terms = command;
+  _sent.clear();
+  // streams are sent as datablocks on the next frame
+  for (const shared_ptr<StreamRing> &stream : _streams) {
+    stream->rendered = 0;
   }
+  _gnuplot_p = gnuplot_p;
+  _filepath = _output;
+  _figure.reset();
+  _auto_native = false;
+#endif
 }
 
-GraphPlotter::Impl::~Impl() {
-  if (_plotted_any) {
-    fputs("\n", _gnuplot_p);
+void GraphPlotter::Impl::_addTerm(const string &term) {
+  lock_guard<mutex> lock(_mutex);
+  if (!_terms.empty()) {
+    _terms += ", ";
   }
-  pclose(_gnuplot_p);
+  _terms += term;
 }
-  
-const char *GraphPlotter::Impl::_tmpName() {
-  static const char tmp_filename_template[] = "/var/tmp/gnuplot_tmpdatafile_XXXXXX";
-  char *tmp_filename = nullptr;
-  size_t tmp_filelen = strlen(tmp_filename_template);
-  tmp_filename = new char [tmp_filelen+1];
-  if (tmp_filename==nullptr) {
-    return nullptr;
+
+void GraphPlotter::Impl::_run() {
+  unique_lock<mutex> lock(_mutex);
+  while (!_stop) {
+    _wakeup.wait_for(lock, chrono::duration<double>(1/_fps), [this]() {
+      return _stop;
+    });
+    if (_stop) {
+      break;
+    }
+    lock.unlock();
+    _render();
+    lock.lock();
   }
-  strcpy(tmp_filename, tmp_filename_template);
-  
-  int unx_fd = mkstemp(tmp_filename);
-  if (unx_fd==-1) {
-    delete [] tmp_filename;
-    return nullptr;
+}
+
+// Resends the streams that changed since the last frame as datablocks and
+// redraws, with replot when the plot command itself is unchanged.
+void GraphPlotter::Impl::_render() {
+  lock_guard<mutex> pipe_lock(_pipe_mutex);
+  string command;
+  vector<StreamRing *> streams;
+  {
+    lock_guard<mutex> lock(_mutex);
+    command = _terms;
+    for (const shared_ptr<StreamRing> &stream : _streams) {
+      streams.push_back(stream.get());
+    }
+  }
+  bool changed = false;
+  vector<double> x;
+  vector<double> y;
+  for (size_t i=0; i<streams.size(); i++) {
+    StreamRing &stream = *streams[i];
+    string name = "$stream" + to_string(i);
+    if (stream.head()!=stream.rendered) {
+      stream.rendered = stream.read(x, y);
+      if (_figure) {
+        _figure->set(stream.series, x.data(), y.data(), x.size());
+      }
+      else {
+        fprintf(_gnuplot_p, "%s << EOD\n", name.c_str());
+        for (size_t j=0; j<x.size(); j++) {
+          fprintf(_gnuplot_p, "%.17g %.17g\n", x[j], y[j]);
+        }
+        fputs("EOD\n", _gnuplot_p);
+      }
+      changed = true;
+    }
+    if (stream.rendered>0) {
+      if (!command.empty()) {
+        command += ", ";
+      }
+      command += name + " using 1:2 " + stream.options();
+    }
+  }
+  if (command.empty() || (!changed && command==_sent)) {
+    return;
+  }
+  if (_figure) {
+    if (!_output.empty()) {
+      _figure->write(_output);
+    }
+    _sent = command;
+    return;
+  }
+  if (!_filepath.empty()) {
+    fprintf(_gnuplot_p, "set output '%s'\n", _filepath.c_str());
+  }
+  if (command==_sent) {
+    fputs("replot\n", _gnuplot_p);
+  }
+  else {
+    fprintf(_gnuplot_p, "plot %s\n", command.c_str());
+    _sent = command;
   }
-  close(unx_fd);
-  return tmp_filename;
+  fflush(_gnuplot_p);
 }
   
 GraphPlotter::GraphPlotter() {
@@ -173,7 +1034,15 @@ GraphPlotter::GraphPlotter() {
 }
 
 GraphPlotter::GraphPlotter(const string &filepath) {
-  _impl = new Impl(filepath);
+  _impl = new Impl(filepath, BACKEND_AUTO);
+}
+
+GraphPlotter::GraphPlotter(const string &filepath, backend_t backend) {
+  _impl = new Impl(filepath, backend);
+}
+
+GraphPlotter::GraphPlotter(GnuplotPool &pool, const string &filepath) {
+  _impl = new Impl(pool, filepath);
 }
 
 GraphPlotter &GraphPlotter::plot(const std::string &equation) {
@@ -184,7 +1053,7 @@ GraphPlotter &GraphPlotter::plot(const std::string &equation) {
 GraphPlotter &GraphPlotter::plot(const double *x_begin,
                                  size_t len,
                                  const string &options) {
-  _impl->plot(x_begin, len, options);
+  _impl->plot(nullptr, Column(x_begin), len, options, "");
   return *this;
 }
 
@@ -192,10 +1061,107 @@ GraphPlotter &GraphPlotter::plot(const double *x_begin,
                                  const double *y_begin,
                                  size_t len,
                                  const string &options) {
-  _impl->plot(x_begin, y_begin, len, options);
+  Column x(x_begin);
+  _impl->plot(&x, Column(y_begin), len, options, "");
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::plot(const Column &y,
+                                 size_t len,
+                                 const string &options) {
+  _impl->plot(nullptr, y, len, options, "");
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::plot(const Column &x,
+                                 const Column &y,
+                                 size_t len,
+                                 const string &options) {
+  _impl->plot(&x, y, len, options, "");
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::plot(const JSON &y, const string &options) {
+  return plot(Column(y), y.size(), options);
+}
+
+GraphPlotter &GraphPlotter::plot(const JSON &x,
+                                 const JSON &y,
+                                 const string &options) {
+  return plot(Column(x), Column(y), min(x.size(), y.size()), options);
+}
+  
+GraphPlotter &GraphPlotter::update(const string &key,
+                                   const Column &y,
+                                   size_t len,
+                                   const string &options) {
+  _impl->plot(nullptr, y, len, options, key);
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::update(const string &key,
+                                   const Column &x,
+                                   const Column &y,
+                                   size_t len,
+                                   const string &options) {
+  _impl->plot(&x, y, len, options, key);
   return *this;
 }
   
+GraphPlotter &GraphPlotter::histogram(const Column &data,
+                                      size_t len,
+                                      size_t bins,
+                                      const string &options) {
+  _impl->histogram(data, len, bins, options);
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::heatmap(const Column &x,
+                                    const Column &y,
+                                    size_t len,
+                                    size_t nx,
+                                    size_t ny,
+                                    const string &options) {
+  _impl->heatmap(x, y, len, nx, ny, options);
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::decimate(decimation_t method, size_t max_points) {
+  _impl->decimate(method, max_points);
+  return *this;
+}
+
+GraphPlotter::Stream GraphPlotter::stream(size_t window,
+                                          const string &options) {
+  Stream stream;
+  stream._ring = _impl->stream(window, options);
+  return stream;
+}
+
+GraphPlotter &GraphPlotter::refresh_rate(double fps) {
+  _impl->refresh_rate(fps);
+  return *this;
+}
+
+GraphPlotter &GraphPlotter::async(size_t queue_size, backpressure_t policy) {
+  _impl->async(queue_size, policy);
+  return *this;
+}
+
+future<void> GraphPlotter::flush() {
+  return _impl->flush();
+}
+
+size_t GraphPlotter::dropped() const {
+  return _impl->dropped();
+}
+
+void GraphPlotter::Stream::append(double x, double y) {
+  if (_ring) {
+    _ring->append(x, y);
+  }
+}
+  
 GraphPlotter::~GraphPlotter() {
   delete _impl;
 }
@@ -27,15 +27,62 @@ THE SOFTWARE.
 #define _GRAPH_PLOTTER_H_
 
 #include <string>
+#include <future>
+#include <memory>
+
+#include "Column.h"
 
 namespace otita {
 
 namespace tool {
 
+class GnuplotPool;
+
 class GraphPlotter {
+  class StreamRing;
 public:
+  // Handle to a live series returned by stream(). append() only stores into
+  // a ring buffer and never waits for gnuplot. A stream must be appended to
+  // from one thread at a time. The handle shares the ring with its plotter,
+  // so it may outlive the plotter; points appended after that are not drawn.
+  class Stream {
+  public:
+    void append(double x, double y);
+  private:
+    friend class GraphPlotter;
+    ::std::shared_ptr<StreamRing> _ring;
+  };
+  enum decimation_t {
+    DECIMATION_NONE,
+    DECIMATION_MINMAX,
+    DECIMATION_LTTB,
+  };
+  // What an async plot() does when the queue is full: wait for the writer,
+  // discard the oldest queued series, or (COALESCE) replace the queued
+  // series with the same update() key, waiting when there is none. Flush
+  // barriers never count as queued.
+  enum backpressure_t {
+    BACKPRESSURE_BLOCK,
+    BACKPRESSURE_DROP_OLDEST,
+    BACKPRESSURE_COALESCE,
+  };
+  // BACKEND_AUTO draws .png and .svg files in-process with Figure and
+  // everything else with gnuplot, or everything in-process when built
+  // without GNUPLOT. Figure only writes .png, .svg and .eps, and cannot draw
+  // equations: with GNUPLOT, the first equation hands an AUTO figure over to
+  // gnuplot.
+  enum backend_t {
+    BACKEND_AUTO,
+    BACKEND_GNUPLOT,
+    BACKEND_NATIVE,
+  };
   GraphPlotter();
   GraphPlotter(const ::std::string &filepath);
+  GraphPlotter(const ::std::string &filepath, backend_t backend);
+  // Renders to filepath like the above, but on a process of pool, which
+  // must outlive the plotter. The destructor hands the figure over without
+  // waiting; see GnuplotPool::wait.
+  GraphPlotter(GnuplotPool &pool, const ::std::string &filepath);
   GraphPlotter &plot(const ::std::string &equation);
   GraphPlotter &plot(const double *x_begin,
                      size_t len,
@@ -44,6 +91,79 @@ public:
                      const double *y_begin,
                      size_t len,
                      const ::std::string &options);
+  // Other element types, strided or field views and JSON arrays; see
+  // Column. Values are converted a chunk at a time as they are sent.
+  GraphPlotter &plot(const Column &y,
+                     size_t len,
+                     const ::std::string &options);
+  GraphPlotter &plot(const Column &x,
+                     const Column &y,
+                     size_t len,
+                     const ::std::string &options);
+  template <class T>
+  GraphPlotter &plot(const T *y_begin,
+                     size_t len,
+                     const ::std::string &options) {
+    return plot(Column(y_begin), len, options);
+  }
+  template <class X, class Y>
+  GraphPlotter &plot(const X *x_begin,
+                     const Y *y_begin,
+                     size_t len,
+                     const ::std::string &options) {
+    return plot(Column(x_begin), Column(y_begin), len, options);
+  }
+  GraphPlotter &plot(const JSON &y, const ::std::string &options);
+  GraphPlotter &plot(const JSON &x,
+                     const JSON &y,
+                     const ::std::string &options);
+  // plot() for a series identified by key, such as one redrawn as it
+  // changes. Under BACKPRESSURE_COALESCE a full queue replaces the series
+  // queued with the same key since the last flush() instead of waiting.
+  GraphPlotter &update(const ::std::string &key,
+                       const Column &y,
+                       size_t len,
+                       const ::std::string &options);
+  GraphPlotter &update(const ::std::string &key,
+                       const Column &x,
+                       const Column &y,
+                       size_t len,
+                       const ::std::string &options);
+  // Counts the len values of data in bins equal-width bins across their
+  // range on all hardware threads (see binning.h) and draws the counts with
+  // boxes, unless options give a style. Only the bins are sent, so drawing
+  // costs the same for any len.
+  GraphPlotter &histogram(const Column &data,
+                          size_t len,
+                          size_t bins,
+                          const ::std::string &options="");
+  // Counts the points in an nx by ny grid across their range and draws the
+  // counts with image, unless options give a style.
+  GraphPlotter &heatmap(const Column &x,
+                        const Column &y,
+                        size_t len,
+                        size_t nx,
+                        size_t ny,
+                        const ::std::string &options="");
+  // Series plotted afterwards that are longer than max_points are reduced to
+  // about max_points points before they are sent (see decimate.h).
+  GraphPlotter &decimate(decimation_t method, size_t max_points=4000);
+  // Adds a series showing the latest window points appended to it. A
+  // background thread redraws the plot whenever streams have changed, at
+  // most refresh_rate() times per second. Each frame rewrites the output
+  // file, if there is one.
+  Stream stream(size_t window, const ::std::string &options);
+  GraphPlotter &refresh_rate(double fps);
+  // Later plot() calls copy their data into a queue of queue_size entries
+  // and return; a writer thread decimates it and talks to gnuplot.
+  GraphPlotter &async(size_t queue_size=16,
+                      backpressure_t policy=BACKPRESSURE_BLOCK);
+  // Draws everything plotted so far. The future is ready once gnuplot has
+  // been sent the plot, at once unless async() is on.
+  ::std::future<void> flush();
+  // Series discarded by BACKPRESSURE_DROP_OLDEST or replaced by
+  // BACKPRESSURE_COALESCE.
+  size_t dropped() const;
   virtual ~GraphPlotter();
 private:
   class Impl;
@@ -26,6 +26,8 @@ THE SOFTWARE.
 #include <stdexcept>
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <cmath>
 #include <cassert>
 
 #include "JSON.h"
@@ -158,6 +160,7 @@ JSON::JSON(JSON &&other) noexcept {
     default:
       break;
   }
+  other._type = JSON_NULL;
 }
 
 JSON &JSON::operator =(const JSON &other) {
@@ -240,6 +243,7 @@ JSON &JSON::operator=(JSON &&other) {
       other._field.object_ptr = nullptr;
     default: ;
   }
+  other._type = JSON_NULL;
   return *this;
 }
 
@@ -340,6 +344,17 @@ JSON::json_t JSON::type() const {
   return _type;
 }
 
+size_t JSON::size() const {
+  switch (_type) {
+    case JSON_ARRAY:
+      return _field.array_ptr->size();
+    case JSON_OBJECT:
+      return _field.object_ptr->size();
+    default:
+      return 0;
+  }
+}
+
 double JSON::number() const {
   JSON_RAISE_EXCEPTION(
     _type == JSON_NUMBER,
@@ -367,6 +382,86 @@ const JSON::json_string &JSON::string() const {
   return *(_field.string_ptr);
 }
 
+static void stringify_string(const JSON::json_string &str, JSON::json_string &out) {
+  out += '"';
+  for (unsigned char c : str) {
+    switch (c) {
+      case '\"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < ' ') {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        }
+        else {
+          out += c;
+        }
+        break;
+    }
+  }
+  out += '"';
+}
+
+JSON::json_string JSON::stringify() const {
+  json_string out;
+  switch (_type) {
+    case JSON_NULL:
+      out = "null";
+      break;
+    case JSON_NUMBER:
+      if (std::isfinite(_field.number)) {
+        // shortest of %.15g and %.17g that reads back exactly
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", _field.number);
+        if (strtod(buf, nullptr) != _field.number) {
+          snprintf(buf, sizeof(buf), "%.17g", _field.number);
+        }
+        out = buf;
+      }
+      else {
+        out = "null";
+      }
+      break;
+    case JSON_BOOLEAN:
+      out = _field.boolean ? "true" : "false";
+      break;
+    case JSON_STRING:
+      stringify_string(*_field.string_ptr, out);
+      break;
+    case JSON_ARRAY:
+      out += '[';
+      for (size_t i = 0; i < _field.array_ptr->size(); i++) {
+        if (i > 0) {
+          out += ',';
+        }
+        out += (*_field.array_ptr)[i]->stringify();
+      }
+      out += ']';
+      break;
+    case JSON_OBJECT:
+      out += '{';
+      for (auto pair : *_field.object_ptr) {
+        if (out.size() > 1) {
+          out += ',';
+        }
+        stringify_string(pair.first, out);
+        out += ':';
+        out += pair.second->stringify();
+      }
+      out += '}';
+      break;
+    default:
+      break;
+  }
+  return out;
+}
+
 struct escape_pair {
   char key;
   char value;
@@ -390,6 +485,7 @@ JSON_Parser::JSON_Parser(const string &source) : _text(source) {
 
 JSON *JSON_Parser::parse() {
   JSON *result = _value();
+  _white();
   if (_ch) {
     // syntax error
     return nullptr;
@@ -432,7 +528,7 @@ JSON *JSON_Parser::_number() {
       str += _ch;
       _next();
     }
-    while (_ch >= '0' && _ch == '9') {
+    while (_ch >= '0' && _ch <= '9') {
       str += _ch;
       _next();
     }
@@ -515,7 +611,7 @@ JSON *JSON_Parser::_array() {
       return new JSON(array_ptr);
     }
     while (_ch) {
-      array_ptr->push_back(new JSON(_value()));
+      array_ptr->push_back(_value());
       _white();
       if (_ch == ']') {
         _next(']');
@@ -66,9 +66,11 @@ public:
   const JSON &operator [](const json_string &key) const;
   virtual ~JSON();
   json_t type() const;
+  size_t size() const;
   double number() const;
   bool   boolean() const;
   const json_string &string() const;
+  json_string stringify() const;
 private:
   union json_field {
     double number;
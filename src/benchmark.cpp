@@ -0,0 +1,345 @@
+//
+//  benchmark.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "benchmark.h"
+#include "JSON.h"
+
+using namespace std;
+
+namespace otita {
+
+namespace tool {
+
+using benchmark_list = vector<pair<string, benchmark_function> >;
+
+static benchmark_list &_benchmarks() {
+  static benchmark_list benchmarks;
+  return benchmarks;
+}
+
+bool register_benchmark(const char name[], benchmark_function function) {
+  _benchmarks().push_back(make_pair(string(name), function));
+  return true;
+}
+
+static double _elapsed(benchmark_function function, size_t iterations) {
+  long long start = timer_clock();
+  function(iterations);
+  clobber_memory();
+  return double(timer_clock() - start);
+}
+
+static bool _pin(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set)==0;
+#else
+  return false;
+#endif
+}
+
+// Runs until options.warmup has passed, then grows the iteration count until
+// one run of the loop lasts options.min_time.
+static size_t _calibrate(benchmark_function function, const BenchmarkOptions &options) {
+  double warmup = options.warmup*1e9;
+  for (double spent=0; spent<warmup; ) {
+    spent += _elapsed(function, 1);
+  }
+  double target = options.min_time*1e9;
+  size_t iterations = 1;
+  for (;;) {
+    double elapsed = _elapsed(function, iterations);
+    if (elapsed>=target || iterations>=(size_t(1) << 40)) {
+      return iterations;
+    }
+    double scale = (elapsed>0) ? 1.4*target/elapsed : 10;
+    iterations = size_t(iterations*min(max(scale, 2.0), 10.0));
+  }
+}
+
+static double _median(vector<double> sorted) {
+  sort(sorted.begin(), sorted.end());
+  size_t n = sorted.size();
+  return (n%2) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2])/2;
+}
+
+static BenchmarkResult _summarize(const string &name, size_t iterations,
+                                  const vector<double> &samples) {
+  BenchmarkResult result;
+  result.name = name;
+  result.iterations = iterations;
+  result.samples = samples;
+  vector<double> sorted = samples;
+  sort(sorted.begin(), sorted.end());
+  size_t n = sorted.size();
+  result.median = _median(sorted);
+  // distribution-free interval from the binomial order statistics
+  double half_width = 1.96*sqrt(double(n))/2;
+  long lo = long(floor(n/2.0 - half_width));
+  long hi = long(ceil(n/2.0 + half_width));
+  result.ci_low = sorted[size_t(max(lo, 1L)) - 1];
+  result.ci_high = sorted[size_t(min(hi, long(n))) - 1];
+  double sum = 0;
+  double sumsq = 0;
+  for (double sample : samples) {
+    sum += sample;
+    sumsq += sample*sample;
+  }
+  result.mean = sum/n;
+  result.stddev = (n>1) ? sqrt(max(sumsq - sum*sum/n, 0.0)/(n-1)) : 0;
+  return result;
+}
+
+vector<BenchmarkResult> run_benchmarks(const BenchmarkOptions &options,
+                                       const string &filter) {
+  if (options.cpu>=0 && !_pin(options.cpu)) {
+    cerr << "cannot pin to cpu " << options.cpu << endl;
+  }
+  vector<BenchmarkResult> results;
+  for (const pair<string, benchmark_function> &benchmark : _benchmarks()) {
+    if (!filter.empty() && benchmark.first.find(filter)==string::npos) {
+      continue;
+    }
+    size_t iterations = _calibrate(benchmark.second, options);
+    vector<double> samples;
+    for (size_t i=0; i<max(options.repetitions, size_t(1)); i++) {
+      samples.push_back(_elapsed(benchmark.second, iterations)/iterations);
+    }
+    results.push_back(_summarize(benchmark.first, iterations, samples));
+    const BenchmarkResult &r = results.back();
+    cout << left << setw(32) << r.name << right
+         << setw(12) << r.iterations << " it "
+         << setw(12) << r.median << " ns"
+         << "  [" << r.ci_low << ", " << r.ci_high << "]"
+         << "  +- " << r.stddev
+         << endl;
+  }
+  return results;
+}
+
+bool save_benchmark_baseline(const vector<BenchmarkResult> &results,
+                             const string &filepath) {
+  JSON root;
+  JSON &benchmarks = root["benchmarks"];
+  for (size_t i=0; i<results.size(); i++) {
+    const BenchmarkResult &r = results[i];
+    JSON &entry = benchmarks[i];
+    entry["name"] = JSON(r.name);
+    entry["iterations"] = JSON(double(r.iterations));
+    entry["median"] = JSON(r.median);
+    entry["ci_low"] = JSON(r.ci_low);
+    entry["ci_high"] = JSON(r.ci_high);
+    JSON &samples = entry["samples"];
+    for (size_t j=0; j<r.samples.size(); j++) {
+      samples[j] = JSON(r.samples[j]);
+    }
+  }
+  ofstream out(filepath.c_str());
+  if (!out.is_open()) {
+    cerr << "cannot open baseline file: " << filepath << endl;
+    return false;
+  }
+  out << root.stringify() << endl;
+  return out.good();
+}
+
+// Two-sided p-value of the Mann-Whitney U test, normal approximation with
+// tie correction.
+static double _mann_whitney(const vector<double> &a, const vector<double> &b) {
+  vector<pair<double, int> > all;
+  for (double x : a) {
+    all.push_back(make_pair(x, 0));
+  }
+  for (double x : b) {
+    all.push_back(make_pair(x, 1));
+  }
+  sort(all.begin(), all.end());
+  double n1 = a.size();
+  double n2 = b.size();
+  double n = n1 + n2;
+  double rank_sum = 0;
+  double ties = 0;
+  for (size_t i=0; i<all.size(); ) {
+    size_t j = i;
+    while (j<all.size() && all[j].first==all[i].first) {
+      j++;
+    }
+    double rank = (i + 1 + j)/2.0;
+    for (size_t k=i; k<j; k++) {
+      if (all[k].second==0) {
+        rank_sum += rank;
+      }
+    }
+    double t = double(j - i);
+    ties += t*t*t - t;
+    i = j;
+  }
+  double u = rank_sum - n1*(n1+1)/2;
+  double mu = n1*n2/2;
+  double sigma = sqrt(n1*n2/12*((n+1) - ties/(n*(n-1))));
+  if (sigma==0) {
+    return 1;
+  }
+  double z = (fabs(u - mu) - 0.5)/sigma;
+  return erfc(max(z, 0.0)/sqrt(2.0));
+}
+
+int compare_benchmark_baseline(const vector<BenchmarkResult> &results,
+                               const string &filepath,
+                               const BenchmarkOptions &options) {
+  ifstream in(filepath.c_str());
+  if (!in.is_open()) {
+    cerr << "cannot open baseline file: " << filepath << endl;
+    return -1;
+  }
+  stringstream source;
+  source << in.rdbuf();
+  unique_ptr<JSON> root(JSON::parse(source.str()));
+  vector<pair<string, vector<double> > > baseline;
+  try {
+    if (!root) {
+      throw logic_error("syntax error");
+    }
+    const JSON &benchmarks = static_cast<const JSON &>(*root)["benchmarks"];
+    for (size_t i=0; i<benchmarks.size(); i++) {
+      const JSON &samples = benchmarks[i]["samples"];
+      baseline.push_back(make_pair(benchmarks[i]["name"].string(), vector<double>()));
+      for (size_t j=0; j<samples.size(); j++) {
+        baseline.back().second.push_back(samples[j].number());
+      }
+    }
+  }
+  catch (const logic_error &) {
+    cerr << "invalid baseline file: " << filepath << endl;
+    return -1;
+  }
+  
+  int regressions = 0;
+  for (const BenchmarkResult &r : results) {
+    vector<pair<string, vector<double> > >::iterator it = baseline.begin();
+    while (it!=baseline.end() && it->first!=r.name) {
+      it++;
+    }
+    if (it==baseline.end() || it->second.empty()) {
+      cout << left << setw(32) << r.name << " not in baseline" << endl;
+      continue;
+    }
+    double before = _median(it->second);
+    double change = (r.median - before)/before;
+    double p = _mann_whitney(it->second, r.samples);
+    bool significant = p<options.alpha && fabs(change)>=options.threshold;
+    cout << left << setw(32) << r.name << right
+         << setw(12) << before << " -> " << setw(12) << r.median << " ns  "
+         << showpos << fixed << setprecision(1) << change*100 << "%"
+         << noshowpos << defaultfloat << setprecision(6)
+         << "  p=" << p;
+    if (significant) {
+      cout << ((change>0) ? "  REGRESSION" : "  improvement");
+      regressions += (change>0);
+    }
+    cout << endl;
+  }
+  return regressions;
+}
+
+int benchmark_main(int argc, char *argv[]) {
+  BenchmarkOptions options;
+  string filter;
+  string save;
+  string compare;
+  for (int i=1; i<argc; i++) {
+    string arg = argv[i];
+    size_t eq = arg.find('=');
+    string key = arg.substr(0, eq);
+    string value = (eq==string::npos) ? "" : arg.substr(eq+1);
+    if (key=="--filter") {
+      filter = value;
+    }
+    else if (key=="--warmup") {
+      options.warmup = atof(value.c_str());
+    }
+    else if (key=="--min_time") {
+      options.min_time = atof(value.c_str());
+    }
+    else if (key=="--repetitions") {
+      options.repetitions = size_t(atol(value.c_str()));
+    }
+    else if (key=="--cpu") {
+      options.cpu = atoi(value.c_str());
+    }
+    else if (key=="--alpha") {
+      options.alpha = atof(value.c_str());
+    }
+    else if (key=="--threshold") {
+      options.threshold = atof(value.c_str());
+    }
+    else if (key=="--save") {
+      save = value;
+    }
+    else if (key=="--compare") {
+      compare = value;
+    }
+    else {
+      cerr << "unrecognized option: " << arg << endl;
+      return 2;
+    }
+  }
+  vector<BenchmarkResult> results = run_benchmarks(options, filter);
+  if (!save.empty() && !save_benchmark_baseline(results, save)) {
+    return 2;
+  }
+  if (!compare.empty()) {
+    int regressions = compare_benchmark_baseline(results, compare, options);
+    if (regressions<0) {
+      return 2;
+    }
+    return (regressions>0) ? 1 : 0;
+  }
+  return 0;
+}
+
+} // tool
+
+} // otita
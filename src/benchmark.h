@@ -0,0 +1,112 @@
+//
+//  benchmark.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "timer.h"
+
+namespace otita {
+
+namespace tool {
+
+// A benchmark body runs the measured code `iterations` times.
+using benchmark_function = void (*)(size_t iterations);
+
+struct BenchmarkOptions {
+  double warmup;        // seconds spent running before calibration
+  double min_time;      // seconds each repetition should last at least
+  size_t repetitions;   // measured repetitions of the calibrated loop
+  int cpu;              // pin the running thread to this CPU when >= 0
+  double alpha;         // significance level of the regression test
+  double threshold;     // smallest relative slowdown reported as regression
+  BenchmarkOptions()
+    : warmup(0.1), min_time(0.05), repetitions(20), cpu(-1),
+      alpha(0.01), threshold(0.02) {}
+};
+
+// Times are nanoseconds per iteration. [ci_low, ci_high] is the 95%
+// confidence interval of the median.
+struct BenchmarkResult {
+  ::std::string name;
+  size_t iterations;
+  double median;
+  double ci_low;
+  double ci_high;
+  double mean;
+  double stddev;
+  ::std::vector<double> samples;
+};
+
+extern bool register_benchmark(const char name[], benchmark_function function);
+extern ::std::vector<BenchmarkResult> run_benchmarks(const BenchmarkOptions &options,
+                                                     const ::std::string &filter="");
+extern bool save_benchmark_baseline(const ::std::vector<BenchmarkResult> &results,
+                                    const ::std::string &filepath);
+// Prints each result against the baseline and returns the number of
+// statistically significant regressions (Mann-Whitney U test), or -1 when
+// the baseline cannot be read.
+extern int compare_benchmark_baseline(const ::std::vector<BenchmarkResult> &results,
+                                      const ::std::string &filepath,
+                                      const BenchmarkOptions &options);
+// Command line driver: --filter= --warmup= --min_time= --repetitions=
+// --cpu= --alpha= --threshold= --save= --compare=
+extern int benchmark_main(int argc, char *argv[]);
+
+// Keeps the compiler from discarding value or the computation producing it.
+template <class T>
+inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Forces pending writes to memory to be treated as observable.
+inline void clobber_memory() {
+  asm volatile("" : : : "memory");
+}
+
+} // tool
+
+} // otita
+
+#define BENCHMARK(name) \
+  static void TIMER_CONCAT(_benchmark_, name)(size_t iterations); \
+  static const bool TIMER_CONCAT(_benchmark_registered_, name) = \
+    ::otita::tool::register_benchmark(#name, TIMER_CONCAT(_benchmark_, name)); \
+  static void TIMER_CONCAT(_benchmark_, name)(size_t iterations)
+
+#define BENCHMARK_MAIN() \
+  int main(int argc, char *argv[]) { \
+    return ::otita::tool::benchmark_main(argc, argv); \
+  }
+
+#endif  // _BENCHMARK_H_
@@ -0,0 +1,211 @@
+//
+//  binning.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <mutex>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+#include "binning.h"
+#include "parallel.h"
+
+using namespace std;
+
+namespace otita {
+
+namespace tool {
+
+static const size_t GRAIN = 1 << 16;
+static const size_t CHUNK = 4096;
+
+// Values [lo, lo+n) of a column: in place when it holds doubles, otherwise
+// converted into buffer.
+static inline const double *_values(const Column &column,
+                                    size_t lo,
+                                    size_t n,
+                                    double *buffer) {
+  const double *doubles = column.doubles();
+  if (doubles!=nullptr) {
+    return doubles + lo;
+  }
+  column.read(lo, n, buffer);
+  return buffer;
+}
+
+static void _range(const Column &data, size_t len, double &lo, double &hi) {
+  mutex merge;
+  lo = DBL_MAX;
+  hi = -DBL_MAX;
+  parallel_for(0, len, GRAIN, [&](size_t begin, size_t end) {
+    double buffer[CHUNK];
+    double local_lo = DBL_MAX;
+    double local_hi = -DBL_MAX;
+    for (size_t i=begin; i<end; i+=CHUNK) {
+      size_t n = min(CHUNK, end - i);
+      const double *values = _values(data, i, n, buffer);
+      for (size_t j=0; j<n; j++) {
+        // false for NaN and infinities
+        bool finite = fabs(values[j])<=DBL_MAX;
+        local_lo = (finite && values[j]<local_lo) ? values[j] : local_lo;
+        local_hi = (finite && values[j]>local_hi) ? values[j] : local_hi;
+      }
+    }
+    lock_guard<mutex> lock(merge);
+    lo = min(lo, local_lo);
+    hi = max(hi, local_hi);
+  });
+  if (lo>hi) {
+    lo = 0;
+    hi = 1;
+  }
+  else if (lo==hi) {
+    // 0.5 is lost in the rounding of large values
+    double margin = max(0.5, fabs(lo)*1e-9);
+    lo = max(lo - margin, -DBL_MAX);
+    hi = min(hi + margin, DBL_MAX);
+    if (lo==hi) {
+      lo = nextafter(lo, -DBL_MAX);
+      hi = nextafter(hi, DBL_MAX);
+    }
+  }
+}
+
+// Factor applied to the values and the range before subtracting, so that
+// the width of a range spanning most of the doubles does not overflow.
+static inline double _half(double lo, double hi) {
+  return (hi - lo<=DBL_MAX) ? 1 : 0.5;
+}
+
+// Bin of each value as a double, or outside for values not in [lo, hi].
+// Values are multiplied by half before lo*half is subtracted and the
+// difference is multiplied by scale. Branch-free so that it vectorizes.
+static inline void _bins(const double *values,
+                         size_t n,
+                         double lo,
+                         double half,
+                         double scale,
+                         size_t bins,
+                         double outside,
+                         double *out) {
+  double top = double(bins);
+  double last = double(bins - 1);
+  double origin = lo*half;
+  for (size_t j=0; j<n; j++) {
+    double t = (values[j]*half - origin)*scale;
+    bool inside = (t>=0) & (t<=top);
+    out[j] = inside ? min(t, last) : outside;
+  }
+}
+
+void bin_1d(const Column &data,
+            size_t len,
+            size_t bins,
+            double &lo,
+            double &hi,
+            vector<double> &counts) {
+  bins = max(bins, size_t(1));
+  _range(data, len, lo, hi);
+  double half = _half(lo, hi);
+  double scale = double(bins)/(hi*half - lo*half);
+  vector<uint64_t> total(bins+1, 0);
+  mutex merge;
+  // a thread only pays off if it counts several times its number of bins
+  parallel_for(0, len, max(GRAIN, 4*bins), [&](size_t begin, size_t end) {
+    // the last bin takes the values that are not counted
+    vector<uint64_t> local(bins+1, 0);
+    double buffer[CHUNK];
+    double bin[CHUNK];
+    for (size_t i=begin; i<end; i+=CHUNK) {
+      size_t n = min(CHUNK, end - i);
+      const double *values = _values(data, i, n, buffer);
+      _bins(values, n, lo, half, scale, bins, double(bins), bin);
+      for (size_t j=0; j<n; j++) {
+        local[size_t(bin[j])]++;
+      }
+    }
+    lock_guard<mutex> lock(merge);
+    for (size_t k=0; k<=bins; k++) {
+      total[k] += local[k];
+    }
+  });
+  counts.assign(total.begin(), total.begin() + bins);
+}
+
+void bin_2d(const Column &x,
+            const Column &y,
+            size_t len,
+            size_t nx,
+            size_t ny,
+            double &x_lo,
+            double &x_hi,
+            double &y_lo,
+            double &y_hi,
+            vector<double> &counts) {
+  nx = max(nx, size_t(1));
+  ny = max(ny, size_t(1));
+  _range(x, len, x_lo, x_hi);
+  _range(y, len, y_lo, y_hi);
+  double x_half = _half(x_lo, x_hi);
+  double y_half = _half(y_lo, y_hi);
+  double x_scale = double(nx)/(x_hi*x_half - x_lo*x_half);
+  double y_scale = double(ny)/(y_hi*y_half - y_lo*y_half);
+  size_t cells = nx*ny;
+  vector<uint64_t> total(cells+1, 0);
+  mutex merge;
+  parallel_for(0, len, max(GRAIN, 4*cells), [&](size_t begin, size_t end) {
+    vector<uint64_t> local(cells+1, 0);
+    double x_buffer[CHUNK];
+    double y_buffer[CHUNK];
+    double x_bin[CHUNK];
+    double y_bin[CHUNK];
+    for (size_t i=begin; i<end; i+=CHUNK) {
+      size_t n = min(CHUNK, end - i);
+      const double *x_values = _values(x, i, n, x_buffer);
+      const double *y_values = _values(y, i, n, y_buffer);
+      // -1 marks a coordinate out of range
+      _bins(x_values, n, x_lo, x_half, x_scale, nx, -1, x_bin);
+      _bins(y_values, n, y_lo, y_half, y_scale, ny, -1, y_bin);
+      for (size_t j=0; j<n; j++) {
+        bool inside = (x_bin[j]>=0) & (y_bin[j]>=0);
+        size_t cell = inside ? size_t(y_bin[j])*nx + size_t(x_bin[j]) : cells;
+        local[cell]++;
+      }
+    }
+    lock_guard<mutex> lock(merge);
+    for (size_t k=0; k<=cells; k++) {
+      total[k] += local[k];
+    }
+  });
+  counts.assign(total.begin(), total.begin() + cells);
+}
+
+} // tool
+
+} // otita
@@ -0,0 +1,70 @@
+//
+//  binning.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _BINNING_H_
+#define _BINNING_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "Column.h"
+
+namespace otita {
+
+namespace tool {
+
+// Counts of values in equal-width bins, computed on all hardware threads
+// with a private set of bins each that are summed at the end. The range is
+// [lo, hi] of the finite values, widened when they are all equal by 0.5 or
+// 1e-9 of their magnitude, whichever is larger, without leaving the finite
+// doubles; values that are not finite are not counted.
+extern void bin_1d(const Column &data,
+                   size_t len,
+                   size_t bins,
+                   double &lo,
+                   double &hi,
+                   ::std::vector<double> &counts);
+// The same over an nx by ny grid of points. counts[iy*nx + ix] is the cell
+// ix along x and iy along y.
+extern void bin_2d(const Column &x,
+                   const Column &y,
+                   size_t len,
+                   size_t nx,
+                   size_t ny,
+                   double &x_lo,
+                   double &x_hi,
+                   double &y_lo,
+                   double &y_hi,
+                   ::std::vector<double> &counts);
+
+} // tool
+
+} // otita
+
+#endif  // _BINNING_H_
@@ -0,0 +1,292 @@
+//
+//  decimate.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "decimate.h"
+#include "parallel.h"
+
+using namespace std;
+
+namespace otita {
+
+namespace tool {
+
+static const size_t GRAIN = 1 << 16;
+static const size_t CHUNK = 4096;
+
+static inline double _x(const Column *x, size_t i) {
+  return (x==nullptr) ? double(i) : (*x)[i];
+}
+
+// Values [lo, hi) of a column: in place when it holds doubles, otherwise
+// converted into buffer.
+static const double *_values(const Column &column,
+                             size_t lo,
+                             size_t hi,
+                             vector<double> &buffer) {
+  const double *doubles = column.doubles();
+  if (doubles!=nullptr) {
+    return doubles + lo;
+  }
+  buffer.resize(hi - lo);
+  column.read(lo, hi - lo, buffer.data());
+  return buffer.data();
+}
+
+static void _copy(const Column *x,
+                  const Column &y,
+                  size_t len,
+                  vector<double> &x_out,
+                  vector<double> &y_out) {
+  x_out.resize(len);
+  y_out.resize(len);
+  y.read(0, len, y_out.data());
+  if (x!=nullptr) {
+    x->read(0, len, x_out.data());
+    return;
+  }
+  for (size_t i=0; i<len; i++) {
+    x_out[i] = double(i);
+  }
+}
+
+static bool _sorted(const Column &x, size_t len) {
+  atomic<bool> sorted(true);
+  parallel_for(1, len, GRAIN, [&](size_t begin, size_t end) {
+    vector<double> buffer;
+    bool ok = true;
+    // chunks overlap by one value so that every pair is compared
+    for (size_t lo=begin-1; lo+1<end; lo+=CHUNK) {
+      size_t hi = min(lo + CHUNK + 1, end);
+      const double *values = _values(x, lo, hi, buffer);
+      for (size_t i=1; i<hi-lo; i++) {
+        ok &= !(values[i]<values[i-1]);
+      }
+    }
+    if (!ok) {
+      sorted.store(false, memory_order_relaxed);
+    }
+  });
+  return sorted.load();
+}
+
+static size_t _lowerBound(const Column &x, size_t len, double value) {
+  size_t lo = 0;
+  size_t hi = len;
+  while (lo<hi) {
+    size_t mid = lo + (hi - lo)/2;
+    if (x[mid]<value) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void decimate_minmax(const Column *x,
+                     const Column &y,
+                     size_t len,
+                     size_t max_points,
+                     vector<double> &x_out,
+                     vector<double> &y_out) {
+  if (len<=max_points || max_points<4) {
+    _copy(x, y, len, x_out, y_out);
+    return;
+  }
+  size_t buckets = max_points/4;
+  vector<size_t> bounds(buckets+1);
+  double x_first = _x(x, 0);
+  double x_last = _x(x, len-1);
+  bool by_x = x!=nullptr && x_last>x_first && _sorted(*x, len);
+  for (size_t b=0; b<=buckets; b++) {
+    if (by_x) {
+      bounds[b] = _lowerBound(*x, len, x_first + (x_last - x_first)*b/buckets);
+    }
+    else {
+      bounds[b] = len*b/buckets;
+    }
+  }
+  bounds[0] = 0;
+  bounds[buckets] = len;
+  
+  vector<size_t> picks(4*buckets, SIZE_MAX);
+  parallel_for(0, buckets, max(GRAIN*buckets/len, size_t(1)), [&](size_t b0, size_t b1) {
+    vector<double> buffer;
+    for (size_t b=b0; b<b1; b++) {
+      size_t lo = bounds[b];
+      size_t hi = bounds[b+1];
+      if (lo>=hi) {
+        continue;
+      }
+      const double *values = _values(y, lo, hi, buffer);
+      size_t n = hi - lo;
+      // branch-free reductions first so that they vectorize, then locate;
+      // NaN fails every comparison so it never becomes an extreme
+      double min_y = HUGE_VAL;
+      double max_y = -HUGE_VAL;
+      bool gap = false;
+      for (size_t i=0; i<n; i++) {
+        min_y = (values[i]<min_y) ? values[i] : min_y;
+        max_y = (values[i]>max_y) ? values[i] : max_y;
+        gap |= values[i]!=values[i];
+      }
+      size_t i_min = 0;
+      while (i_min<n-1 && values[i_min]!=min_y) {
+        i_min++;
+      }
+      size_t i_max = 0;
+      while (i_max<n-1 && values[i_max]!=max_y) {
+        i_max++;
+      }
+      if (gap) {
+        // keep a NaN so that the line stays broken, in place of the extreme
+        // nearer the first point
+        size_t i_nan = 0;
+        while (values[i_nan]==values[i_nan]) {
+          i_nan++;
+        }
+        if (fabs(values[i_min] - values[0])>fabs(values[i_max] - values[0])) {
+          i_max = i_nan;
+        }
+        else {
+          i_min = i_nan;
+        }
+      }
+      size_t *pick = &picks[4*b];
+      pick[0] = lo;
+      pick[1] = lo + min(i_min, i_max);
+      pick[2] = lo + max(i_min, i_max);
+      pick[3] = hi-1;
+    }
+  });
+  
+  x_out.clear();
+  y_out.clear();
+  x_out.reserve(picks.size());
+  y_out.reserve(picks.size());
+  size_t last = SIZE_MAX;
+  for (size_t i : picks) {
+    if (i==SIZE_MAX || i==last) {
+      continue;
+    }
+    x_out.push_back(_x(x, i));
+    y_out.push_back(y[i]);
+    last = i;
+  }
+}
+
+void decimate_lttb(const Column *x,
+                   const Column &y,
+                   size_t len,
+                   size_t max_points,
+                   vector<double> &x_out,
+                   vector<double> &y_out) {
+  if (len<=max_points || max_points<3) {
+    _copy(x, y, len, x_out, y_out);
+    return;
+  }
+  // bucket k in [0, buckets) covers [start(k), start(k+1)) of the points
+  // strictly between the first and the last
+  size_t buckets = max_points - 2;
+  double every = double(len - 2)/buckets;
+  auto start = [&](size_t k) {
+    return min(size_t(floor(k*every)) + 1, len - 1);
+  };
+  vector<size_t> selected(max_points);
+  selected[0] = 0;
+  selected[max_points-1] = len - 1;
+  
+  parallel_for(0, buckets, max(GRAIN*buckets/len, size_t(1)), [&](size_t k0, size_t k1) {
+    vector<double> x_buffer;
+    vector<double> y_buffer;
+    size_t anchor = start(k0) - 1;
+    for (size_t k=k0; k<k1; k++) {
+      double avg_x = 0;
+      double avg_y = 0;
+      size_t next_lo = start(k+1);
+      size_t next_hi = (k+1<buckets) ? start(k+2) : len;
+      // the average of the next bucket skips NaN points
+      const double *next_y = _values(y, next_lo, next_hi, y_buffer);
+      const double *next_x = (x==nullptr) ? nullptr : _values(*x, next_lo, next_hi, x_buffer);
+      size_t count = 0;
+      for (size_t i=0; i<next_hi-next_lo; i++) {
+        bool valid = next_y[i]==next_y[i];
+        avg_y += valid ? next_y[i] : 0;
+        avg_x += valid ? ((next_x==nullptr) ? double(next_lo + i) : next_x[i]) : 0;
+        count += valid;
+      }
+      avg_x /= double(max(count, size_t(1)));
+      avg_y /= double(max(count, size_t(1)));
+      
+      double ax = _x(x, anchor);
+      double ay = y[anchor];
+      size_t lo = start(k);
+      size_t hi = start(k+1);
+      const double *values_y = _values(y, lo, hi, y_buffer);
+      const double *values_x = (x==nullptr) ? nullptr : _values(*x, lo, hi, x_buffer);
+      size_t best = lo;
+      double best_area = -1;
+      bool gap = false;
+      for (size_t i=0; i<hi-lo; i++) {
+        if (values_y[i]!=values_y[i]) {
+          // a NaN is selected so that the line stays broken
+          best = lo + i;
+          gap = true;
+          break;
+        }
+        double px = (values_x==nullptr) ? double(lo + i) : values_x[i];
+        double area = fabs((ax - avg_x)*(values_y[i] - ay) - (ax - px)*(avg_y - ay));
+        if (area>best_area) {
+          best_area = area;
+          best = lo + i;
+        }
+      }
+      selected[k+1] = best;
+      if (!gap) {
+        anchor = best;
+      }
+    }
+  });
+  
+  x_out.resize(max_points);
+  y_out.resize(max_points);
+  for (size_t i=0; i<max_points; i++) {
+    x_out[i] = _x(x, selected[i]);
+    y_out[i] = y[selected[i]];
+  }
+}
+
+} // tool
+
+} // otita
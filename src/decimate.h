@@ -0,0 +1,93 @@
+//
+//  decimate.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _DECIMATE_H_
+#define _DECIMATE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "Column.h"
+
+namespace otita {
+
+namespace tool {
+
+// Level-of-detail reduction of a series for display. x may be nullptr, in
+// which case x is the index. Series no longer than max_points are copied.
+// Columns that are not contiguous doubles are converted one bucket at a
+// time. A bucket holding a NaN keeps one, so gaps in the line survive.
+//
+// decimate_minmax keeps the first, minimum, maximum and last point of each
+// of max_points/4 buckets. Buckets are equal x ranges (pixel columns) when x
+// is sorted, and equal index ranges otherwise, so a line plot at that width
+// draws the same pixels as the full series.
+extern void decimate_minmax(const Column *x,
+                            const Column &y,
+                            size_t len,
+                            size_t max_points,
+                            ::std::vector<double> &x_out,
+                            ::std::vector<double> &y_out);
+// Largest-Triangle-Three-Buckets: max_points points chosen to preserve the
+// visual shape. Runs on chunks of buckets in parallel; each chunk starts
+// from the last input point before it rather than the previous selection.
+extern void decimate_lttb(const Column *x,
+                          const Column &y,
+                          size_t len,
+                          size_t max_points,
+                          ::std::vector<double> &x_out,
+                          ::std::vector<double> &y_out);
+
+inline void decimate_minmax(const double *x_begin,
+                            const double *y_begin,
+                            size_t len,
+                            size_t max_points,
+                            ::std::vector<double> &x_out,
+                            ::std::vector<double> &y_out) {
+  Column x(x_begin);
+  decimate_minmax((x_begin==nullptr) ? nullptr : &x, Column(y_begin),
+                  len, max_points, x_out, y_out);
+}
+
+inline void decimate_lttb(const double *x_begin,
+                          const double *y_begin,
+                          size_t len,
+                          size_t max_points,
+                          ::std::vector<double> &x_out,
+                          ::std::vector<double> &y_out) {
+  Column x(x_begin);
+  decimate_lttb((x_begin==nullptr) ? nullptr : &x, Column(y_begin),
+                len, max_points, x_out, y_out);
+}
+
+} // tool
+
+} // otita
+
+#endif  // _DECIMATE_H_
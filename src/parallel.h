@@ -0,0 +1,88 @@
+//
+//  parallel.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace otita {
+
+namespace tool {
+
+// Splits [begin, end) into one contiguous chunk per hardware thread, at
+// least grain elements each, and calls f(chunk_begin, chunk_end) for every
+// chunk concurrently. The calling thread runs the first chunk. If f throws,
+// the first chunk's exception is rethrown once every chunk has finished.
+template <class F>
+void parallel_for(size_t begin, size_t end, size_t grain, F f) {
+  if (end<=begin) {
+    return;
+  }
+  size_t len = end - begin;
+  size_t threads = ::std::max(::std::thread::hardware_concurrency(), 1u);
+  threads = ::std::min(threads, ::std::max(len/::std::max(grain, size_t(1)), size_t(1)));
+  if (threads<=1) {
+    f(begin, end);
+    return;
+  }
+  ::std::vector< ::std::exception_ptr> errors(threads);
+  auto run = [&](size_t i) {
+    try {
+      F chunk(f);
+      chunk(begin + len*i/threads, begin + len*(i+1)/threads);
+    }
+    catch (...) {
+      errors[i] = ::std::current_exception();
+    }
+  };
+  ::std::vector< ::std::thread> workers;
+  workers.reserve(threads-1);
+  for (size_t i=1; i<threads; i++) {
+    workers.emplace_back(run, i);
+  }
+  run(0);
+  for (::std::thread &worker : workers) {
+    worker.join();
+  }
+  for (const ::std::exception_ptr &error : errors) {
+    if (error) {
+      ::std::rethrow_exception(error);
+    }
+  }
+}
+
+} // tool
+
+} // otita
+
+#endif  // _PARALLEL_H_
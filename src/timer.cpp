@@ -26,13 +26,51 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
-
 #include <iostream>
+#include <fstream>
 #include <unordered_map>
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
 
-#include <ctime>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #include "timer.h"
+#include "JSON.h"
+
+#ifdef TIMER_TRACK_ALLOC
+#include <new>
+#include <cerrno>
+#if defined(__GLIBC__)
+#include <malloc.h>
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+#endif
 
 using namespace std;
 
@@ -42,50 +80,1179 @@ namespace tool {
   
 const char TIMER_KEY_ALL[] = "TIMER_KEY_ALL";
 
+// TIMER_CLOCK may name a function returning nanoseconds to use in place of
+// the steady clock, so that tests can time regions exactly.
+static int64_t _now() {
+#ifdef TIMER_CLOCK
+  return TIMER_CLOCK();
+#else
+  return chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+long long timer_clock() {
+  return _now();
+}
+
+#ifndef TIMER_DISABLE
+
+// Log-linear bucketing of nanosecond durations: exact below 16ns, then 16
+// linear sub-buckets per power of two.
+class Histogram {
+public:
+  static const size_t SUB_BUCKET_BITS = 4;
+  static const size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+  static size_t bucket(int64_t value) {
+    if (value<int64_t(SUB_BUCKETS)) {
+      return (value<0) ? 0 : size_t(value);
+    }
+    size_t exponent = 63 - __builtin_clzll(uint64_t(value));
+    size_t shift = exponent - SUB_BUCKET_BITS;
+    return (shift+1)*SUB_BUCKETS + ((uint64_t(value) >> shift) & (SUB_BUCKETS-1));
+  }
+  static double value(size_t bucket) {
+    if (bucket<SUB_BUCKETS) {
+      return double(bucket);
+    }
+    size_t shift = bucket/SUB_BUCKETS - 1;
+    double width = ldexp(1.0, int(shift));
+    return (SUB_BUCKETS + bucket%SUB_BUCKETS)*width + width/2;
+  }
+  static double percentile(const vector<uint64_t> &counts, uint64_t total, double q) {
+    uint64_t rank = uint64_t(ceil(q*total));
+    uint64_t seen = 0;
+    for (size_t i=0; i<counts.size(); i++) {
+      seen += counts[i];
+      if (seen>=rank && seen>0) {
+        return value(i);
+      }
+    }
+    return 0;
+  }
+};
+
+// Bumped by reset_timer(). Owners keep min/max of the current and previous
+// epoch in alternating windows, so a reset never has to write to their slots.
+static atomic<uint64_t> _epoch(0);
+
+// Events kept per thread while trace recording is on; 0 when it is off.
+static atomic<size_t> _trace_capacity(0);
+static int64_t _trace_origin = 0;
+
+static atomic<bool> _counters_enabled(false);
+
+// Append-only array for state shared between the owning thread and readers.
+// Elements never move once published; only the owner grows the array, and
+// any thread may read the elements below size().
+template <class T>
+class PublishedArray {
+public:
+  PublishedArray() : _size(0) {
+    for (size_t i=0; i<MAX_SEGMENTS; i++) {
+      _segments[i].store(nullptr, memory_order_relaxed);
+    }
+  }
+  ~PublishedArray() {
+    for (size_t i=0; i<MAX_SEGMENTS; i++) {
+      delete [] _segments[i].load(memory_order_relaxed);
+    }
+  }
+  size_t size() const {
+    return _size.load(memory_order_acquire);
+  }
+  // Owner only.
+  T &operator [](size_t i) {
+    return _segments[i/SEGMENT_SIZE].load(memory_order_relaxed)[i%SEGMENT_SIZE];
+  }
+  const T &operator [](size_t i) const {
+    return _segments[i/SEGMENT_SIZE].load(memory_order_acquire)[i%SEGMENT_SIZE];
+  }
+  // Owner only. Makes room for index i without publishing it, and returns
+  // the element or nullptr when the array is full.
+  T *reserve(size_t i) {
+    if (i/SEGMENT_SIZE>=MAX_SEGMENTS) {
+      cerr << "too many timers" << endl;
+      return nullptr;
+    }
+    if (_segments[i/SEGMENT_SIZE].load(memory_order_relaxed)==nullptr) {
+      _segments[i/SEGMENT_SIZE].store(new T[SEGMENT_SIZE], memory_order_release);
+    }
+    return &(*this)[i];
+  }
+  // Owner only. Makes the elements below size visible to readers.
+  void publish(size_t size) {
+    _size.store(size, memory_order_release);
+  }
+  // Owner only. Grows the array to hold index i and returns the element, or
+  // nullptr when the array is full.
+  T *grow(size_t i) {
+    size_t size = _size.load(memory_order_relaxed);
+    if (i<size) {
+      return &(*this)[i];
+    }
+    for (size_t s=size; s<=i; s+=SEGMENT_SIZE) {
+      if (reserve(s)==nullptr) {
+        return nullptr;
+      }
+    }
+    if (reserve(i)==nullptr) {
+      return nullptr;
+    }
+    publish(i+1);
+    return &(*this)[i];
+  }
+private:
+  static const size_t SEGMENT_SIZE = 64;
+  static const size_t MAX_SEGMENTS = 1024;
+  atomic<size_t> _size;
+  atomic<T *> _segments[MAX_SEGMENTS];
+};
+
+// Event counters of the calling thread, opened as one perf_event group so that
+// a single read() returns all of them. Counters the kernel refuses (typically
+// hardware events inside containers and VMs) are left out; when none can be
+// opened the timer falls back to time only. The descriptors are closed with
+// the thread's ThreadTimer when the thread exits.
+class PerfCounters {
+public:
+  enum counter_t {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    PAGE_FAULTS,
+    COUNTERS,
+  };
+  struct Sample {
+    uint64_t values[COUNTERS];
+    uint64_t enabled;
+    uint64_t running;
+  };
+  PerfCounters() : _opened(false), _leader(-1), _mask(0), _size(0) {}
+  ~PerfCounters() {
+    for (size_t i=0; i<_size; i++) {
+      close(_fds[i]);
+    }
+  }
+  // Opens the group on first use. Returns false when no counter is usable.
+  bool available() {
+    if (!_opened) {
+      _open();
+    }
+    return _leader!=-1;
+  }
+  // Bit i is set when counter i is being counted.
+  unsigned mask() const {
+    return _mask;
+  }
+  bool read(Sample &sample) {
+#ifdef __linux__
+    uint64_t buf[3+COUNTERS];
+    ssize_t n = ::read(_leader, buf, sizeof(buf));
+    if (n<ssize_t(3*sizeof(uint64_t)) || buf[0]!=_size) {
+      return false;
+    }
+    sample.enabled = buf[1];
+    sample.running = buf[2];
+    for (size_t i=0; i<_size; i++) {
+      sample.values[_counters[i]] = buf[3+i];
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+private:
+  bool _opened;
+  int _leader;
+  unsigned _mask;
+  size_t _size;
+  int _fds[COUNTERS];
+  counter_t _counters[COUNTERS];
+  void _open() {
+    _opened = true;
+#ifdef __linux__
+    static const struct {
+      uint32_t type;
+      uint64_t config;
+    } events[COUNTERS] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    };
+    for (size_t i=0; i<COUNTERS; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP |
+                         PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, _leader, PERF_FLAG_FD_CLOEXEC));
+      if (fd==-1) {
+        continue;
+      }
+      if (_leader==-1) {
+        _leader = fd;
+      }
+      _fds[_size] = fd;
+      _counters[_size] = counter_t(i);
+      _mask |= 1u << i;
+      _size++;
+    }
+#endif
+    if (_leader==-1) {
+      static atomic<bool> warned(false);
+      if (!warned.exchange(true)) {
+        cerr << "performance counters unavailable, timing only" << endl;
+      }
+    }
+  }
+};
+
+// Set on a thread while the timer does its own bookkeeping there, so that
+// the allocation hooks keep it out of the regions being timed.
+static thread_local bool _timer_busy = false;
+
+struct TimerBusy {
+  bool saved;
+  TimerBusy() : saved(_timer_busy) {
+    _timer_busy = true;
+  }
+  ~TimerBusy() {
+    _timer_busy = saved;
+  }
+};
+
+// Timer state owned by a single thread. Flat statistics are indexed by region
+// id, and nested regions form a call tree of nodes. Only the owning thread
+// writes to it; readers load published elements concurrently through relaxed
+// atomics, so tic/toc never take a lock or do an atomic read-modify-write.
+class ThreadTimer {
+public:
+  struct Window {
+    atomic<uint64_t> epoch;
+    atomic<int64_t> min;
+    atomic<int64_t> max;
+    atomic<int64_t> peak_bytes;
+    Window() : epoch(UINT64_MAX), min(0), max(0), peak_bytes(0) {}
+  };
+  struct Slot {
+    atomic<bool> used;
+    atomic<uint64_t> count;
+    atomic<int64_t> total;
+    atomic<double> sumsq;
+    Window window[2];
+    atomic<uint64_t> *histogram;
+    atomic<unsigned> counter_mask;
+    atomic<uint64_t> counters[PerfCounters::COUNTERS];
+    atomic<uint64_t> allocations;
+    atomic<uint64_t> allocated_bytes;
+    Slot() : used(false), count(0), total(0), sumsq(0), histogram(nullptr), counter_mask(0),
+             allocations(0), allocated_bytes(0) {
+      for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+        counters[i].store(0, memory_order_relaxed);
+      }
+    }
+    ~Slot() {
+      delete [] histogram;
+    }
+  };
+  // A call path. Node 0 is the root; parents always precede their children.
+  struct Node {
+    size_t parent;
+    size_t region;
+    atomic<uint64_t> count;
+    atomic<int64_t> total;
+    Node() : parent(0), region(SIZE_MAX), count(0), total(0) {}
+  };
+  ThreadTimer(size_t id) : _id(id), _ring(nullptr) {
+    _nodes.reserve(0);
+    _nodes.publish(1);
+    _children.resize(1);
+    _stack.reserve(64);
+  }
+  ~ThreadTimer() {
+    delete _ring.load(memory_order_relaxed);
+  }
+  size_t id() const {
+    return _id;
+  }
+  // Opens a frame for region, or restarts it if it is already open.
+  void tic(size_t region) {
+    TimerBusy busy;
+    Slot *slot = _slots.grow(region);
+    if (slot==nullptr) {
+      return;
+    }
+    if (!slot->used.load(memory_order_relaxed)) {
+      slot->histogram = new atomic<uint64_t>[Histogram::BUCKETS]();
+      slot->used.store(true, memory_order_release);
+      _marks.resize(_slots.size());
+    }
+    Mark &mark = _marks[region];
+    if (mark.frame==SIZE_MAX) {
+      mark.frame = _stack.size();
+      size_t node = _child(_stack.empty() ? 0 : _stack.back().node, region);
+      _stack.push_back(Frame());
+      _stack.back().region = region;
+      _stack.back().node = node;
+    }
+    Frame &frame = _stack[mark.frame];
+    frame.allocations = 0;
+    frame.allocated_bytes = 0;
+    frame.live_bytes = 0;
+    frame.peak_bytes = 0;
+    frame.counted = _counters_enabled.load(memory_order_relaxed) &&
+                    _perf.available() && _perf.read(frame.counters);
+    frame.start = _now();
+  }
+  // Closes the open frame of region. Frames opened after it keep running, so
+  // overlapping tic/toc pairs still time each name correctly. A toc on a
+  // closed region times the lap since its previous toc.
+  bool toc(size_t region) {
+    int64_t t = _now();
+    TimerBusy busy;
+    if (region>=_marks.size()) {
+      return false;
+    }
+    Mark &mark = _marks[region];
+    if (mark.frame==SIZE_MAX) {
+      if (mark.lap<0) {
+        return false;
+      }
+      _close(region, mark.node, mark.lap, t - mark.lap);
+      mark.lap = t;
+      return true;
+    }
+    size_t i = mark.frame;
+    Frame &frame = _stack[i];
+    _close(region, frame.node, frame.start, t - frame.start);
+    if (frame.counted) {
+      _count(&_slots[region], frame.counters);
+    }
+#ifdef TIMER_TRACK_ALLOC
+    _allocated(&_slots[region], frame);
+    if (i>0) {
+      // fold into the enclosing frame so that its counts are inclusive
+      Frame &parent = _stack[i-1];
+      parent.allocations += frame.allocations;
+      parent.allocated_bytes += frame.allocated_bytes;
+      parent.peak_bytes = max(parent.peak_bytes, parent.live_bytes + frame.peak_bytes);
+      parent.live_bytes += frame.live_bytes;
+    }
+#endif
+    mark.frame = SIZE_MAX;
+    mark.lap = t;
+    mark.node = frame.node;
+    if (i+1==_stack.size()) {
+      _stack.pop_back();
+      return true;
+    }
+    _stack.erase(_stack.begin() + i);
+    for (size_t j=i; j<_stack.size(); j++) {
+      _marks[_stack[j].region].frame = j;
+    }
+    return true;
+  }
+#ifdef TIMER_TRACK_ALLOC
+  // Called by the allocation hooks on the owning thread. Allocations are
+  // charged to the innermost open region, and to its ancestors when it closes.
+  void allocated(size_t size, size_t usable) {
+    if (_timer_busy || _stack.empty()) {
+      return;
+    }
+    Frame &frame = _stack.back();
+    frame.allocations++;
+    frame.allocated_bytes += size;
+    frame.live_bytes += usable;
+    frame.peak_bytes = max(frame.peak_bytes, frame.live_bytes);
+  }
+  void freed(size_t usable) {
+    if (_timer_busy || _stack.empty()) {
+      return;
+    }
+    _stack.back().live_bytes -= usable;
+  }
+#endif
+  // Owner-only cache of name lookups, so that only the first tic of a name
+  // on each thread touches the global registry.
+  size_t *cachedRegion(const char name[]) {
+    unordered_map<string, size_t>::iterator it = _regions.find(name);
+    return (it==_regions.end()) ? nullptr : &it->second;
+  }
+  void cacheRegion(const char name[], size_t region) {
+    _regions.insert(make_pair(string(name), region));
+  }
+  // Safe to call from any thread.
+  template <class F>
+  void forEach(F f) const {
+    size_t size = _slots.size();
+    for (size_t i=0; i<size; i++) {
+      const Slot &slot = _slots[i];
+      if (slot.used.load(memory_order_acquire)) {
+        f(i, slot);
+      }
+    }
+  }
+  // Safe to call from any thread. Visits nodes in parent-first order.
+  template <class F>
+  void forEachNode(F f) const {
+    size_t size = _nodes.size();
+    for (size_t i=1; i<size; i++) {
+      f(i, _nodes[i]);
+    }
+  }
+  // Safe to call from any thread. Visits the recorded trace events that are
+  // still in the ring, oldest first, as f(region, start, duration).
+  template <class F>
+  void forEachEvent(F f) const {
+    lock_guard<mutex> lock(_ring_mutex);
+    const TraceRing *ring = _ring.load(memory_order_acquire);
+    if (ring==nullptr) {
+      return;
+    }
+    uint64_t head = ring->head.load(memory_order_acquire);
+    uint64_t first = (head>ring->capacity) ? head - ring->capacity : 0;
+    for (uint64_t i=first; i<head; i++) {
+      const TraceEvent &event = ring->events[i%ring->capacity];
+      uint64_t seq = event.seq.load(memory_order_acquire);
+      size_t region = event.region.load(memory_order_relaxed);
+      int64_t start = event.start.load(memory_order_relaxed);
+      int64_t duration = event.duration.load(memory_order_relaxed);
+      atomic_thread_fence(memory_order_acquire);
+      if (seq!=i+1 || event.seq.load(memory_order_relaxed)!=seq) {
+        continue;  // overwritten by the owner while reading
+      }
+      f(region, start, duration);
+    }
+  }
+private:
+  // Ring buffer slot guarded by a per-slot sequence number: 0 while the owner
+  // writes it, then the 1-based index of the event it holds.
+  struct TraceEvent {
+    atomic<uint64_t> seq;
+    atomic<size_t> region;
+    atomic<int64_t> start;
+    atomic<int64_t> duration;
+    TraceEvent() : seq(0), region(0), start(0), duration(0) {}
+  };
+  struct TraceRing {
+    size_t capacity;
+    unique_ptr<TraceEvent[]> events;
+    atomic<uint64_t> head;
+    TraceRing(size_t capacity) : capacity(capacity), events(new TraceEvent[capacity]), head(0) {}
+  };
+  // Owner-only state of a region: the index of its open frame in the stack,
+  // or else when and where its last lap ended.
+  struct Mark {
+    size_t frame;
+    int64_t lap;
+    size_t node;
+    Mark() : frame(SIZE_MAX), lap(-1), node(SIZE_MAX) {}
+  };
+  struct Frame {
+    size_t region;
+    size_t node;
+    int64_t start;
+    bool counted;
+    PerfCounters::Sample counters;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    int64_t live_bytes;
+    int64_t peak_bytes;
+  };
+  size_t _id;
+  PublishedArray<Slot> _slots;
+  PublishedArray<Node> _nodes;
+  atomic<TraceRing *> _ring;
+  // taken by the owner only to replace the ring
+  mutable mutex _ring_mutex;
+  // owner only
+  vector<vector<pair<size_t, size_t> > > _children;
+  vector<Frame> _stack;
+  vector<Mark> _marks;
+  unordered_map<string, size_t> _regions;
+  PerfCounters _perf;
+  size_t _child(size_t parent, size_t region) {
+    if (parent==SIZE_MAX) {
+      return SIZE_MAX;
+    }
+    for (const pair<size_t, size_t> &child : _children[parent]) {
+      if (child.first==region) {
+        return child.second;
+      }
+    }
+    size_t i = _children.size();
+    Node *node = _nodes.reserve(i);
+    if (node==nullptr) {
+      return SIZE_MAX;
+    }
+    node->parent = parent;
+    node->region = region;
+    _nodes.publish(i+1);
+    _children.resize(i+1);
+    _children[parent].push_back(make_pair(region, i));
+    return i;
+  }
+  void _close(size_t region, size_t node, int64_t start, int64_t duration) {
+    _record(&_slots[region], duration);
+    if (node!=SIZE_MAX) {
+      Node &n = _nodes[node];
+      n.count.store(n.count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+      n.total.store(n.total.load(memory_order_relaxed) + duration, memory_order_relaxed);
+    }
+    size_t trace_capacity = _trace_capacity.load(memory_order_relaxed);
+    if (trace_capacity>0) {
+      _trace(region, start, duration, trace_capacity);
+    }
+  }
+  void _count(Slot *slot, const PerfCounters::Sample &start) {
+    PerfCounters::Sample end;
+    if (!_perf.read(end) || end.running==start.running) {
+      return;
+    }
+    // scale up if the kernel multiplexed the group during the region
+    double scale = double(end.enabled - start.enabled)/(end.running - start.running);
+    unsigned mask = _perf.mask();
+    for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+      if (mask & (1u << i)) {
+        uint64_t delta = uint64_t((end.values[i] - start.values[i])*scale);
+        slot->counters[i].store(slot->counters[i].load(memory_order_relaxed) + delta,
+                                memory_order_relaxed);
+      }
+    }
+    slot->counter_mask.store(mask, memory_order_relaxed);
+  }
+  void _allocated(Slot *slot, const Frame &frame) {
+    slot->allocations.store(slot->allocations.load(memory_order_relaxed) + frame.allocations,
+                            memory_order_relaxed);
+    slot->allocated_bytes.store(slot->allocated_bytes.load(memory_order_relaxed) +
+                                frame.allocated_bytes,
+                                memory_order_relaxed);
+    // _record() has already moved the window to the current epoch
+    Window &window = slot->window[_epoch.load(memory_order_relaxed)&1];
+    if (frame.peak_bytes>window.peak_bytes.load(memory_order_relaxed)) {
+      window.peak_bytes.store(frame.peak_bytes, memory_order_relaxed);
+    }
+  }
+  void _trace(size_t region, int64_t start, int64_t duration, size_t capacity) {
+    TraceRing *ring = _ring.load(memory_order_relaxed);
+    if (ring==nullptr || ring->capacity!=capacity) {
+      // a new size drops the events recorded so far; readers hold the lock
+      // while they walk the ring
+      lock_guard<mutex> lock(_ring_mutex);
+      delete ring;
+      ring = new TraceRing(capacity);
+      _ring.store(ring, memory_order_release);
+    }
+    uint64_t head = ring->head.load(memory_order_relaxed);
+    TraceEvent &event = ring->events[head%ring->capacity];
+    event.seq.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event.region.store(region, memory_order_relaxed);
+    event.start.store(start, memory_order_relaxed);
+    event.duration.store(duration, memory_order_relaxed);
+    event.seq.store(head+1, memory_order_release);
+    ring->head.store(head+1, memory_order_release);
+  }
+  static void _record(Slot *slot, int64_t duration) {
+    slot->count.store(slot->count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    slot->total.store(slot->total.load(memory_order_relaxed) + duration, memory_order_relaxed);
+    slot->sumsq.store(slot->sumsq.load(memory_order_relaxed) + double(duration)*duration,
+                      memory_order_relaxed);
+    atomic<uint64_t> &bucket = slot->histogram[Histogram::bucket(duration)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    
+    uint64_t epoch = _epoch.load(memory_order_relaxed);
+    Window &window = slot->window[epoch&1];
+    if (window.epoch.load(memory_order_relaxed)!=epoch) {
+      window.min.store(duration, memory_order_relaxed);
+      window.max.store(duration, memory_order_relaxed);
+      window.peak_bytes.store(0, memory_order_relaxed);
+      window.epoch.store(epoch, memory_order_release);
+    }
+    else {
+      if (duration<window.min.load(memory_order_relaxed)) {
+        window.min.store(duration, memory_order_relaxed);
+      }
+      if (duration>window.max.load(memory_order_relaxed)) {
+        window.max.store(duration, memory_order_relaxed);
+      }
+    }
+  }
+};
+
+static thread_local ThreadTimer *_thread_timer = nullptr;
+
+// Hands the thread's timer back to the registry when the thread exits.
+struct ThreadTimerOwner {
+  ~ThreadTimerOwner();
+};
+
+static thread_local ThreadTimerOwner _thread_timer_owner;
+// Set once the owner is gone; a timer registered after that is never freed.
+static thread_local bool _thread_exited = false;
+
 class Timer {
-  using time_table = unordered_map<string, pair<clock_t, clock_t> >;
 public:
   static Timer &getInstance() {
-    static Timer timer;
-    return timer;
+    // never destroyed: threads may still be timing during static destruction
+    static Timer *timer = new Timer;
+    return *timer;
   }
-  void tic(const char name[]) {
-    time_table::iterator it = _time_table.find(name);
-    if (it==_time_table.end()) {
-      clock_t t = clock();
-      _time_table.insert(make_pair(name, make_pair(t, 0)));
+  ThreadTimer &local() {
+    if (_thread_timer==nullptr) {
+      _thread_timer = _register();
+      if (!_thread_exited) {
+        (void)&_thread_timer_owner;
+      }
     }
-    else {
-      it->second.first = clock();
+    return *_thread_timer;
+  }
+  // Folds the statistics, call tree and trace events of an exiting thread
+  // into the retired totals and frees its timer, so that short-lived threads
+  // do not accumulate.
+  void retire(ThreadTimer *thread) {
+    lock_guard<mutex> lock(_mutex);
+    uint64_t epoch = _epoch.load(memory_order_relaxed);
+    if (_retired_epoch!=epoch) {
+      for (auto &p : _retired) {
+        p.second.resetWindow();
+      }
+      _retired_epoch = epoch;
+    }
+    _add(_retired, *thread, epoch, false);
+    _addTree(_retired_tree, *thread);
+    RetiredTrace trace;
+    trace.thread = thread->id();
+    thread->forEachEvent([&](size_t region, int64_t start, int64_t duration) {
+      trace.events.push_back(TraceRecord{region, start, duration});
+    });
+    if (!trace.events.empty()) {
+      _retired_events += trace.events.size();
+      _retired_traces.push_back(move(trace));
+      while (_retired_events>RETIRED_EVENTS) {
+        _retired_events -= _retired_traces.front().events.size();
+        _retired_traces.pop_front();
+      }
+    }
+    for (size_t i=0; i<_threads.size(); i++) {
+      if (_threads[i].get()==thread) {
+        _threads.erase(_threads.begin() + i);
+        break;
+      }
+    }
+  }
+  size_t region(const char name[]) {
+    TimerBusy busy;
+    lock_guard<mutex> lock(_mutex);
+    unordered_map<string, size_t>::iterator it = _regions.find(name);
+    if (it!=_regions.end()) {
+      return it->second;
+    }
+    _names.push_back(name);
+    _regions.insert(make_pair(_names.back(), _names.size()-1));
+    return _names.size()-1;
+  }
+  // The name lookup builds a string, so the whole path counts as the
+  // timer's own work.
+  void tic(const char name[]) {
+    TimerBusy busy;
+    ThreadTimer &thread_timer = local();
+    size_t *cached = thread_timer.cachedRegion(name);
+    if (cached!=nullptr) {
+      thread_timer.tic(*cached);
+      return;
     }
+    size_t id = region(name);
+    thread_timer.cacheRegion(name, id);
+    thread_timer.tic(id);
   }
   void toc(const char name[]) {
-    time_table::iterator it = _time_table.find(name);
-    if (it==_time_table.end()) {
+    TimerBusy busy;
+    ThreadTimer &thread_timer = local();
+    size_t *cached = thread_timer.cachedRegion(name);
+    if (cached==nullptr || !thread_timer.toc(*cached)) {
       cerr << "unrecognized name: " << name << endl;
-      return;
     }
-    clock_t t = clock();
-    it->second.second += t - it->second.first;
-    it->second.first = t;
+  }
+  void tic(size_t region) {
+    local().tic(region);
+  }
+  void toc(size_t region) {
+    if (!local().toc(region)) {
+      cerr << "unrecognized name: " << _name(region) << endl;
+    }
+  }
+  vector<TimerStats> snapshot(bool reset) {
+    lock_guard<mutex> lock(_mutex);
+    uint64_t epoch = _epoch.load(memory_order_relaxed);
+    map<size_t, Totals> current = _collect(epoch);
+    vector<TimerStats> result = _delta(current, _baseline, false);
+    if (reset) {
+      _baseline.swap(current);
+      _tree_baseline = _collectTree();
+      _epoch.store(epoch+1, memory_order_relaxed);
+    }
+    return result;
+  }
+  // Statistics since the previous call for the reporter, which keeps a
+  // baseline of its own so that it and reset_timer() do not disturb each
+  // other. The min/max windows follow reset_timer(), so min and max come
+  // from the histogram. restart only sets the baseline.
+  // The threads are summed without the lock, so that a timing thread that
+  // registers a name or exits does not wait for the reporter.
+  vector<TimerStats> report(bool restart) {
+    map<size_t, Totals> current;
+    vector<shared_ptr<ThreadTimer> > threads;
+    uint64_t epoch;
+    {
+      lock_guard<mutex> lock(_mutex);
+      epoch = _epoch.load(memory_order_relaxed);
+      current = _collectRetired(epoch);
+      threads = _threads;
+    }
+    for (const shared_ptr<ThreadTimer> &thread : threads) {
+      _add(current, *thread, epoch, true);
+    }
+    lock_guard<mutex> lock(_mutex);
+    vector<TimerStats> result;
+    if (!restart) {
+      result = _delta(current, _reporter_baseline, true);
+    }
+    _reporter_baseline.swap(current);
+    return result;
+  }
+  void showTree() {
+    lock_guard<mutex> lock(_mutex);
+    call_tree tree = _tree();
+    for (call_tree::iterator it=tree.begin(); it!=tree.end(); it++) {
+      const TreeNode &node = it->second;
+      if (node.count==0 && node.children==0) {
+        continue;
+      }
+      cout << string(2*(it->first.size()-1), ' ')
+           << _displayName(it->first.back()) << ": "
+           << _seconds(node.total) << "(s)"
+           << " self " << _seconds(max(node.total - node.children, int64_t(0))) << "(s)"
+           << " [count " << node.count << "]"
+           << endl;
+    }
+  }
+  void startTrace(size_t events_per_thread) {
+    lock_guard<mutex> lock(_mutex);
+    if (_trace_origin==0) {
+      _trace_origin = _now();
+    }
+    _trace_capacity.store(max(events_per_thread, size_t(1)), memory_order_relaxed);
+  }
+  void stopTrace() {
+    _trace_capacity.store(0, memory_order_relaxed);
+  }
+  // Writes the Chrome Trace Event format, which chrome://tracing and Perfetto
+  // open directly. Regions become complete ("X") events, so a region closed
+  // out of order still renders as one span.
+  bool writeTrace(const string &filepath) {
+    // copied under the lock, so that registering threads do not wait for
+    // the file
+    vector<string> names;
+    deque<RetiredTrace> traces;
+    int64_t origin;
+    {
+      lock_guard<mutex> lock(_mutex);
+      for (size_t i=0; i<_names.size(); i++) {
+        names.push_back(JSON(_displayName(i)).stringify());
+      }
+      for (const shared_ptr<ThreadTimer> &thread : _threads) {
+        traces.push_back(RetiredTrace());
+        traces.back().thread = thread->id();
+        thread->forEachEvent([&](size_t region, int64_t start, int64_t duration) {
+          traces.back().events.push_back(TraceRecord{region, start, duration});
+        });
+      }
+      traces.insert(traces.end(), _retired_traces.begin(), _retired_traces.end());
+      origin = _trace_origin;
+    }
+    ofstream out(filepath.c_str());
+    if (!out.is_open()) {
+      cerr << "cannot open trace file: " << filepath << endl;
+      return false;
+    }
+    long pid = long(getpid());
+    char buf[64];
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (const RetiredTrace &trace : traces) {
+      out << (first ? "\n" : ",\n")
+          << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << trace.thread
+          << ",\"args\":{\"name\":\"thread " << trace.thread << "\"}}";
+      first = false;
+      for (const TraceRecord &event : trace.events) {
+        // regions opened before tracing started are cut at its start
+        int64_t start = max(event.start, origin);
+        int64_t duration = max(event.duration - (start - event.start), int64_t(0));
+        snprintf(buf, sizeof(buf), "%.3f,\"dur\":%.3f",
+                 (start - origin)/1e3, duration/1e3);
+        out << ",\n{\"name\":" << names[event.region]
+            << ",\"ph\":\"X\",\"ts\":" << buf
+            << ",\"pid\":" << pid << ",\"tid\":" << trace.thread << "}";
+      }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out.good();
+  }
+  // One line per call path: frames joined by ';' and the exclusive time in
+  // microseconds, as consumed by flamegraph.pl and speedscope.
+  void writeFolded(ostream &out) {
+    lock_guard<mutex> lock(_mutex);
+    call_tree tree = _tree();
+    for (call_tree::iterator it=tree.begin(); it!=tree.end(); it++) {
+      int64_t self = (it->second.total - it->second.children)/1000;
+      if (self<=0) {
+        continue;
+      }
+      string path;
+      for (size_t region : it->first) {
+        string name = _displayName(region);
+        replace(name.begin(), name.end(), ';', ':');
+        replace(name.begin(), name.end(), ' ', '_');
+        path += (path.empty() ? "" : ";") + name;
+      }
+      out << path << ' ' << self << '\n';
+    }
+    out.flush();
   }
   void show() {
-    for (time_table::iterator it=_time_table.begin(); it!=_time_table.end(); it++) {
-      string name = (it->first==TIMER_KEY_ALL) ? "all" : it->first;
-      cout << name << ": "
-           << double(it->second.second)/CLOCKS_PER_SEC << "(s)"
+    vector<TimerStats> stats = snapshot(false);
+    sort(stats.begin(), stats.end(), [](const TimerStats &a, const TimerStats &b) {
+      return a.name<b.name;
+    });
+    for (const TimerStats &s : stats) {
+      string name = (s.name==TIMER_KEY_ALL) ? "all" : s.name;
+      cout << name << ": " << s.total << "(s)"
+           << " [count " << s.count
+           << ", mean " << s.mean
+           << ", stddev " << s.stddev
+           << ", min " << s.min
+           << ", max " << s.max
+           << ", p50 " << s.p50
+           << ", p90 " << s.p90
+           << ", p99 " << s.p99
+           << ", p99.9 " << s.p999 << "]"
            << endl;
+      if (s.cycles>0 && s.instructions>=0) {
+        cout << "  ipc " << double(s.instructions)/s.cycles;
+      }
+      if (s.instructions>0) {
+        if (s.cache_misses>=0) {
+          cout << "  cache MPKI " << 1000.0*s.cache_misses/s.instructions;
+        }
+        if (s.branch_misses>=0) {
+          cout << "  branch MPKI " << 1000.0*s.branch_misses/s.instructions;
+        }
+      }
+      if (s.page_faults>=0) {
+        cout << "  page faults " << s.page_faults;
+      }
+      if (s.cycles>=0 || s.instructions>=0 || s.page_faults>=0) {
+        cout << endl;
+      }
+      if (s.allocations>=0) {
+        cout << "  allocations " << s.allocations
+             << ", allocated " << s.allocated_bytes << "(B)"
+             << ", peak live " << s.peak_bytes << "(B)"
+             << endl;
+      }
+      if (s.threads.size()>1) {
+        for (const pair<size_t, double> &p : s.threads) {
+          cout << "  thread " << p.first << ": " << p.second << "(s)" << endl;
+        }
+      }
     }
   }
 private:
-  time_table _time_table;
-  Timer() {}
+  // Cumulative values of one region summed over threads.
+  struct Totals {
+    uint64_t count;
+    int64_t total;
+    double sumsq;
+    int64_t min;
+    int64_t max;
+    vector<uint64_t> histogram;
+    map<size_t, pair<uint64_t, int64_t> > threads;
+    unsigned counter_mask;
+    uint64_t counters[PerfCounters::COUNTERS];
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    int64_t peak_bytes;
+    Totals() : count(0), total(0), sumsq(0), min(INT64_MAX), max(0),
+               histogram(Histogram::BUCKETS, 0), counter_mask(0),
+               allocations(0), allocated_bytes(0), peak_bytes(0) {
+      for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+        counters[i] = 0;
+      }
+    }
+    void resetWindow() {
+      min = INT64_MAX;
+      max = 0;
+      peak_bytes = 0;
+    }
+    // Bounds of the histogram in place of the min/max window.
+    void histogramRange() {
+      resetWindow();
+      for (size_t i=0; i<histogram.size(); i++) {
+        if (histogram[i]>0) {
+          min = std::min(min, int64_t(Histogram::value(i)));
+          max = int64_t(Histogram::value(i));
+        }
+      }
+    }
+    void subtract(const Totals &other) {
+      count -= other.count;
+      total -= other.total;
+      sumsq -= other.sumsq;
+      for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+        counters[i] -= other.counters[i];
+      }
+      allocations -= other.allocations;
+      allocated_bytes -= other.allocated_bytes;
+      for (size_t i=0; i<histogram.size(); i++) {
+        histogram[i] -= other.histogram[i];
+      }
+      for (auto &p : other.threads) {
+        map<size_t, pair<uint64_t, int64_t> >::iterator it = threads.find(p.first);
+        if (it!=threads.end()) {
+          it->second.first -= p.second.first;
+          it->second.second -= p.second.second;
+        }
+      }
+    }
+    TimerStats stats(const string &name) const {
+      TimerStats s;
+      s.name = name;
+      s.count = count;
+      s.total = _seconds(total);
+      s.mean = s.total/count;
+      double variance = sumsq/count - double(total)/count*(double(total)/count);
+      s.stddev = _seconds(sqrt(std::max(variance, 0.0)));
+      s.min = (min<=max) ? _seconds(min) : 0;
+      s.max = _seconds(max);
+      double *percentiles[] = {&s.p50, &s.p90, &s.p99, &s.p999};
+      double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+      for (size_t i=0; i<4; i++) {
+        double value = _seconds(Histogram::percentile(histogram, count, quantiles[i]));
+        *percentiles[i] = (min<=max) ? std::min(std::max(value, s.min), s.max) : value;
+      }
+      for (auto &p : threads) {
+        if (p.second.first>0) {
+          s.threads.push_back(make_pair(p.first, _seconds(p.second.second)));
+        }
+      }
+      long long *event_counts[] = {
+        &s.cycles, &s.instructions, &s.cache_misses, &s.branch_misses, &s.page_faults,
+      };
+      for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+        *event_counts[i] = (counter_mask & (1u << i)) ? (long long)counters[i] : -1;
+      }
+#ifdef TIMER_TRACK_ALLOC
+      s.allocations = (long long)allocations;
+      s.allocated_bytes = (long long)allocated_bytes;
+      s.peak_bytes = peak_bytes;
+#else
+      s.allocations = -1;
+      s.allocated_bytes = -1;
+      s.peak_bytes = -1;
+#endif
+      return s;
+    }
+  };
+  // Call paths merged over threads. Inclusive totals, plus the inclusive
+  // total of direct children so that exclusive time is total - children.
+  struct TreeNode {
+    uint64_t count;
+    int64_t total;
+    int64_t children;
+    TreeNode() : count(0), total(0), children(0) {}
+  };
+  using call_tree = map<vector<size_t>, TreeNode>;
+  struct TraceRecord {
+    size_t region;
+    int64_t start;
+    int64_t duration;
+  };
+  struct RetiredTrace {
+    size_t thread;
+    vector<TraceRecord> events;
+  };
+  // trace events kept from exited threads, oldest threads dropped first
+  static const size_t RETIRED_EVENTS = 1 << 20;
+  mutex _mutex;
+  vector<shared_ptr<ThreadTimer> > _threads;
+  size_t _next_thread;
+  // what exited threads left behind; min/max belong to _retired_epoch
+  map<size_t, Totals> _retired;
+  uint64_t _retired_epoch;
+  call_tree _retired_tree;
+  deque<RetiredTrace> _retired_traces;
+  size_t _retired_events;
+  vector<string> _names;
+  unordered_map<string, size_t> _regions;
+  map<size_t, Totals> _baseline;
+  map<size_t, Totals> _reporter_baseline;
+  call_tree _tree_baseline;
+  Timer() : _next_thread(0), _retired_epoch(0), _retired_events(0) {}
   Timer(const Timer &other) {}
   Timer &operator=(const Timer &other) {
     return Timer::getInstance();
   }
+  ThreadTimer *_register() {
+    TimerBusy busy;
+    lock_guard<mutex> lock(_mutex);
+    _threads.emplace_back(new ThreadTimer(_next_thread++));
+    return _threads.back().get();
+  }
+  string _name(size_t region) {
+    TimerBusy busy;
+    lock_guard<mutex> lock(_mutex);
+    return (region<_names.size()) ? _names[region] : to_string(region);
+  }
+  // Caller holds _mutex.
+  string _displayName(size_t region) const {
+    return (_names[region]==TIMER_KEY_ALL) ? "all" : _names[region];
+  }
+  // Caller holds _mutex.
+  call_tree _collectTree() {
+    call_tree tree = _retired_tree;
+    for (const shared_ptr<ThreadTimer> &thread : _threads) {
+      _addTree(tree, *thread);
+    }
+    return tree;
+  }
+  static void _addTree(call_tree &tree, const ThreadTimer &thread) {
+    vector<vector<size_t> > paths(1);
+    thread.forEachNode([&](size_t i, const ThreadTimer::Node &node) {
+      paths.resize(i+1);
+      paths[i] = paths[node.parent];
+      paths[i].push_back(node.region);
+      TreeNode &t = tree[paths[i]];
+      t.count += node.count.load(memory_order_relaxed);
+      t.total += node.total.load(memory_order_relaxed);
+    });
+  }
+  // Caller holds _mutex. The call tree since the last reset.
+  call_tree _tree() {
+    call_tree tree = _collectTree();
+    for (call_tree::iterator it=tree.begin(); it!=tree.end(); it++) {
+      call_tree::iterator base = _tree_baseline.find(it->first);
+      if (base!=_tree_baseline.end()) {
+        it->second.count -= base->second.count;
+        it->second.total -= base->second.total;
+      }
+    }
+    for (call_tree::iterator it=tree.begin(); it!=tree.end(); it++) {
+      if (it->first.size()>1) {
+        vector<size_t> parent(it->first.begin(), it->first.end()-1);
+        tree[parent].children += it->second.total;
+      }
+    }
+    return tree;
+  }
+  // Caller holds _mutex. The regions that ran since baseline.
+  vector<TimerStats> _delta(const map<size_t, Totals> &current,
+                            const map<size_t, Totals> &baseline,
+                            bool histogram_range) {
+    vector<TimerStats> result;
+    for (map<size_t, Totals>::const_iterator it=current.begin(); it!=current.end(); it++) {
+      Totals delta = it->second;
+      map<size_t, Totals>::const_iterator base = baseline.find(it->first);
+      if (base!=baseline.end()) {
+        delta.subtract(base->second);
+      }
+      if (delta.count==0) {
+        continue;
+      }
+      if (histogram_range) {
+        delta.histogramRange();
+      }
+      result.push_back(delta.stats(_names[it->first]));
+    }
+    return result;
+  }
+  // Caller holds _mutex. What exited threads left, with the min/max window
+  // of epoch.
+  map<size_t, Totals> _collectRetired(uint64_t epoch) {
+    map<size_t, Totals> totals = _retired;
+    if (_retired_epoch!=epoch) {
+      for (auto &p : totals) {
+        p.second.resetWindow();
+      }
+    }
+    return totals;
+  }
+  // Caller holds _mutex.
+  map<size_t, Totals> _collect(uint64_t epoch) {
+    map<size_t, Totals> totals = _collectRetired(epoch);
+    for (const shared_ptr<ThreadTimer> &thread : _threads) {
+      _add(totals, *thread, epoch, true);
+    }
+    return totals;
+  }
+  // Adds the slots of one thread, and its share per region if per_thread.
+  static void _add(map<size_t, Totals> &totals,
+                   const ThreadTimer &thread,
+                   uint64_t epoch,
+                   bool per_thread) {
+    thread.forEach([&](size_t region, const ThreadTimer::Slot &slot) {
+      Totals &t = totals[region];
+      uint64_t count = slot.count.load(memory_order_relaxed);
+      int64_t total = slot.total.load(memory_order_relaxed);
+      t.count += count;
+      t.total += total;
+      t.sumsq += slot.sumsq.load(memory_order_relaxed);
+      for (size_t i=0; i<Histogram::BUCKETS; i++) {
+        t.histogram[i] += slot.histogram[i].load(memory_order_relaxed);
+      }
+      const ThreadTimer::Window &window = slot.window[epoch&1];
+      if (window.epoch.load(memory_order_acquire)==epoch) {
+        t.min = min(t.min, window.min.load(memory_order_relaxed));
+        t.max = max(t.max, window.max.load(memory_order_relaxed));
+        t.peak_bytes = max(t.peak_bytes, window.peak_bytes.load(memory_order_relaxed));
+      }
+      if (per_thread) {
+        t.threads[thread.id()] = make_pair(count, total);
+      }
+      t.counter_mask |= slot.counter_mask.load(memory_order_relaxed);
+      for (size_t i=0; i<PerfCounters::COUNTERS; i++) {
+        t.counters[i] += slot.counters[i].load(memory_order_relaxed);
+      }
+      t.allocations += slot.allocations.load(memory_order_relaxed);
+      t.allocated_bytes += slot.allocated_bytes.load(memory_order_relaxed);
+    });
+  }
+  static double _seconds(double ns) {
+    return ns/1e9;
+  }
 };
     
+ThreadTimerOwner::~ThreadTimerOwner() {
+  _thread_exited = true;
+  ThreadTimer *thread = _thread_timer;
+  if (thread!=nullptr) {
+    // the allocation hooks must not reach it any more
+    _thread_timer = nullptr;
+    Timer::getInstance().retire(thread);
+  }
+}
+
 void tic(const char name[]) {
   Timer::getInstance().tic(name);
 }
@@ -98,6 +1265,425 @@ void show_timer() {
   Timer::getInstance().show();
 }
 
+vector<TimerStats> snapshot_timer(bool reset) {
+  return Timer::getInstance().snapshot(reset);
+}
+
+void reset_timer() {
+  Timer::getInstance().snapshot(true);
+}
+
+void show_timer_tree() {
+  Timer::getInstance().showTree();
+}
+
+void write_timer_folded(ostream &out) {
+  Timer::getInstance().writeFolded(out);
+}
+
+void enable_timer_counters(bool enable) {
+  _counters_enabled.store(enable, memory_order_relaxed);
+}
+
+// Snapshots the aggregates every interval on its own thread, against its own
+// baseline. The timing threads never wait for it: the registry lock it takes
+// is off their hot path.
+class TimerReporter {
+public:
+  TimerReporter(double interval, const string &filepath, timer_report_t format)
+    : _interval(interval), _filepath(filepath), _format(format), _stop(false),
+      _last(chrono::steady_clock::now()) {
+    Timer::getInstance().report(true);
+    _thread = thread(&TimerReporter::_run, this);
+  }
+  ~TimerReporter() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wakeup.notify_all();
+    _thread.join();
+  }
+private:
+  struct Cumulative {
+    unsigned long long count;
+    double total;
+    Cumulative() : count(0), total(0) {}
+  };
+  double _interval;
+  string _filepath;
+  timer_report_t _format;
+  bool _stop;
+  chrono::steady_clock::time_point _last;
+  map<string, Cumulative> _cumulative;
+  mutex _mutex;
+  condition_variable _wakeup;
+  thread _thread;
+  void _run() {
+    unique_lock<mutex> lock(_mutex);
+    while (!_stop) {
+      _wakeup.wait_for(lock, chrono::duration<double>(_interval), [this]() {
+        return _stop;
+      });
+      lock.unlock();
+      _report();
+      lock.lock();
+    }
+  }
+  void _report() {
+    vector<TimerStats> stats = Timer::getInstance().report(false);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - _last).count();
+    _last = now;
+    if (_format==TIMER_REPORT_PROMETHEUS) {
+      _writePrometheus(stats);
+    }
+    else {
+      _writeJSONLine(stats, elapsed);
+    }
+  }
+  void _writeJSONLine(const vector<TimerStats> &stats, double elapsed) {
+    JSON line;
+    line["time"] = JSON(chrono::duration<double>(
+      chrono::system_clock::now().time_since_epoch()).count());
+    line["interval"] = JSON(elapsed);
+    JSON &regions = line["regions"];
+    regions = JSON(new JSON::json_array);
+    for (size_t i=0; i<stats.size(); i++) {
+      const TimerStats &s = stats[i];
+      JSON &region = regions[i];
+      region["name"] = JSON((s.name==TIMER_KEY_ALL) ? "all" : s.name);
+      region["count"] = JSON(double(s.count));
+      region["total"] = JSON(s.total);
+      region["mean"] = JSON(s.mean);
+      region["stddev"] = JSON(s.stddev);
+      region["min"] = JSON(s.min);
+      region["max"] = JSON(s.max);
+      region["p50"] = JSON(s.p50);
+      region["p90"] = JSON(s.p90);
+      region["p99"] = JSON(s.p99);
+      region["p999"] = JSON(s.p999);
+      if (s.allocations>=0) {
+        region["allocations"] = JSON(double(s.allocations));
+        region["allocated_bytes"] = JSON(double(s.allocated_bytes));
+        region["peak_bytes"] = JSON(double(s.peak_bytes));
+      }
+    }
+    ofstream out(_filepath.c_str(), ios::app);
+    if (!out.is_open()) {
+      cerr << "cannot open report file: " << _filepath << endl;
+      return;
+    }
+    out << line.stringify() << endl;
+  }
+  // Quoted label value; the exposition format only knows \\, \" and \n.
+  static string _labelValue(const string &value) {
+    string quoted = "\"";
+    for (char c : value) {
+      if (c=='\\' || c=='"') {
+        quoted += '\\';
+        quoted += c;
+      }
+      else if (c=='\n') {
+        quoted += "\\n";
+      }
+      else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+  // Text exposition format for a node_exporter textfile collector. Quantiles
+  // cover the last interval; _sum and _count are cumulative as Prometheus
+  // expects. The file is replaced atomically.
+  void _writePrometheus(const vector<TimerStats> &stats) {
+    for (const TimerStats &s : stats) {
+      Cumulative &c = _cumulative[s.name];
+      c.count += s.count;
+      c.total += s.total;
+    }
+    map<string, const TimerStats *> latest;
+    for (const TimerStats &s : stats) {
+      latest[s.name] = &s;
+    }
+    string tmp_path = _filepath + ".tmp";
+    ofstream out(tmp_path.c_str());
+    if (!out.is_open()) {
+      cerr << "cannot open report file: " << tmp_path << endl;
+      return;
+    }
+    out << "# TYPE timer_region_seconds summary\n";
+    for (map<string, Cumulative>::iterator it=_cumulative.begin(); it!=_cumulative.end(); it++) {
+      string label = "region=" + _labelValue((it->first==TIMER_KEY_ALL) ? "all" : it->first);
+      map<string, const TimerStats *>::iterator s = latest.find(it->first);
+      if (s!=latest.end()) {
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        const double values[] = {s->second->p50, s->second->p90, s->second->p99, s->second->p999};
+        for (size_t i=0; i<4; i++) {
+          out << "timer_region_seconds{" << label << ",quantile=\"" << quantiles[i] << "\"} "
+              << values[i] << "\n";
+        }
+      }
+      out << "timer_region_seconds_sum{" << label << "} " << it->second.total << "\n";
+      out << "timer_region_seconds_count{" << label << "} " << it->second.count << "\n";
+    }
+    out << "# TYPE timer_region_max_seconds gauge\n";
+    for (map<string, const TimerStats *>::iterator it=latest.begin(); it!=latest.end(); it++) {
+      string label = "region=" + _labelValue((it->first==TIMER_KEY_ALL) ? "all" : it->first);
+      out << "timer_region_max_seconds{" << label << "} " << it->second->max << "\n";
+    }
+    out.close();
+    if (!out || rename(tmp_path.c_str(), _filepath.c_str())!=0) {
+      cerr << "cannot write report file: " << _filepath << endl;
+    }
+  }
+};
+
+static mutex _reporter_mutex;
+static unique_ptr<TimerReporter> _reporter;
+
+void start_timer_reporter(double interval, const string &filepath, timer_report_t format) {
+  static bool registered = false;
+  lock_guard<mutex> lock(_reporter_mutex);
+  if (!registered) {
+    atexit(stop_timer_reporter);
+    registered = true;
+  }
+  _reporter.reset();
+  _reporter.reset(new TimerReporter(interval, filepath, format));
+}
+
+void stop_timer_reporter() {
+  lock_guard<mutex> lock(_reporter_mutex);
+  _reporter.reset();
+}
+
+static string _trace_on_exit;
+
+static void _write_trace_on_exit() {
+  Timer::getInstance().writeTrace(_trace_on_exit);
+}
+
+void start_timer_trace(size_t events_per_thread, const string &dump_on_exit) {
+  if (!dump_on_exit.empty()) {
+    if (_trace_on_exit.empty()) {
+      atexit(_write_trace_on_exit);
+    }
+    _trace_on_exit = dump_on_exit;
+  }
+  Timer::getInstance().startTrace(events_per_thread);
+}
+
+void stop_timer_trace() {
+  Timer::getInstance().stopTrace();
+}
+
+bool write_timer_trace(const string &filepath) {
+  return Timer::getInstance().writeTrace(filepath);
+}
+
+TimerRegion register_timer(const char name[]) {
+  return TimerRegion{Timer::getInstance().region(name)};
+}
+
+void tic(TimerRegion region) {
+  Timer::getInstance().tic(region.id);
+}
+
+void toc(TimerRegion region) {
+  Timer::getInstance().toc(region.id);
+}
+
+#endif // TIMER_DISABLE
+
+} // tool
+
+} // otita
+
+#if defined(TIMER_TRACK_ALLOC) && !defined(TIMER_DISABLE)
+
+// Allocation hooks for TIMER_TRACK_ALLOC. Global operator new/delete are
+// replaced everywhere; with glibc the malloc family is interposed as well and
+// operator new goes straight to the underlying allocator, so nothing is
+// counted twice.
+
+namespace otita {
+
+namespace tool {
+
+static size_t _usable_size(void *ptr) {
+#if defined(__GLIBC__)
+  return malloc_usable_size(ptr);
+#elif defined(__APPLE__)
+  return malloc_size(ptr);
+#else
+  return 0;
+#endif
+}
+
+static void _on_alloc(void *ptr, size_t size) {
+  if (ptr!=nullptr && _thread_timer!=nullptr) {
+    _thread_timer->allocated(size, _usable_size(ptr));
+  }
+}
+
+static void _on_release(size_t usable) {
+  if (_thread_timer!=nullptr) {
+    _thread_timer->freed(usable);
+  }
+}
+
+static void _on_free(void *ptr) {
+  if (ptr!=nullptr) {
+    _on_release(_usable_size(ptr));
+  }
+}
+
+static void *_raw_malloc(size_t size) {
+#if defined(__GLIBC__)
+  return __libc_malloc(size);
+#else
+  return malloc(size);
+#endif
+}
+
+static void _raw_free(void *ptr) {
+#if defined(__GLIBC__)
+  __libc_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+static void *_new(size_t size) {
+  for (;;) {
+    void *ptr = _raw_malloc(size ? size : 1);
+    if (ptr!=nullptr) {
+      _on_alloc(ptr, size);
+      return ptr;
+    }
+    new_handler handler = get_new_handler();
+    if (handler==nullptr) {
+      throw bad_alloc();
+    }
+    handler();
+  }
+}
+
+static void _delete(void *ptr) {
+  _on_free(ptr);
+  _raw_free(ptr);
+}
+
 } // tool
 
 } // otita
+
+void *operator new(size_t size) {
+  return otita::tool::_new(size);
+}
+
+void *operator new[](size_t size) {
+  return otita::tool::_new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+  try {
+    return otita::tool::_new(size);
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+  try {
+    return otita::tool::_new(size);
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void *ptr) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+void operator delete(void *ptr, const nothrow_t &) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+void operator delete[](void *ptr, const nothrow_t &) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  otita::tool::_delete(ptr);
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void *malloc(size_t size) {
+  void *ptr = __libc_malloc(size);
+  otita::tool::_on_alloc(ptr, size);
+  return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+  void *ptr = __libc_calloc(count, size);
+  otita::tool::_on_alloc(ptr, count*size);
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+  size_t usable = (ptr!=nullptr) ? otita::tool::_usable_size(ptr) : 0;
+  void *result = __libc_realloc(ptr, size);
+  if (result!=nullptr || size==0) {
+    otita::tool::_on_release(usable);
+    otita::tool::_on_alloc(result, size);
+  }
+  return result;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  void *ptr = __libc_memalign(alignment, size);
+  otita::tool::_on_alloc(ptr, size);
+  return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) {
+  if (alignment<sizeof(void *) || (alignment & (alignment - 1))!=0) {
+    return EINVAL;
+  }
+  void *ptr = memalign(alignment, size);
+  if (ptr==nullptr) {
+    return ENOMEM;
+  }
+  *result = ptr;
+  return 0;
+}
+
+void free(void *ptr) {
+  otita::tool::_on_free(ptr);
+  __libc_free(ptr);
+}
+
+} // extern "C"
+
+#endif // __GLIBC__
+
+#endif // TIMER_TRACK_ALLOC
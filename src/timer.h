@@ -30,18 +30,167 @@ THE SOFTWARE.
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <utility>
+
 namespace otita {
 
 namespace tool {
 
 extern const char TIMER_KEY_ALL[];
-  
+
+enum timer_report_t {
+  TIMER_REPORT_JSON_LINES,
+  TIMER_REPORT_PROMETHEUS,
+};
+
+struct TimerRegion {
+  size_t id;
+};
+
+// Statistics of one region since the last reset, in seconds. Percentiles come
+// from a log-linear histogram and are accurate to about 3%.
+struct TimerStats {
+  ::std::string name;
+  unsigned long long count;
+  double total;
+  double min;
+  double max;
+  double mean;
+  double stddev;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  // (thread, total) for each running thread that ran the region; threads
+  // that have exited only count towards the totals
+  ::std::vector<::std::pair<size_t, double> > threads;
+  // Event counts from enable_timer_counters(); -1 when not available.
+  long long cycles;
+  long long instructions;
+  long long cache_misses;
+  long long branch_misses;
+  long long page_faults;
+  // Heap use inside the region, nested regions included, when built with
+  // TIMER_TRACK_ALLOC; -1 otherwise.
+  long long allocations;
+  long long allocated_bytes;
+  long long peak_bytes;
+};
+
+// Nanoseconds on the monotonic clock used by tic/toc.
+extern long long timer_clock();
+
+#ifndef TIMER_DISABLE
+
+// A tic on a region that is already open restarts it, and a toc on a closed
+// region adds the lap since its previous toc.
 extern void tic(const char name[]=TIMER_KEY_ALL);
 extern void toc(const char name[]=TIMER_KEY_ALL);
 extern void show_timer();
+extern ::std::vector<TimerStats> snapshot_timer(bool reset=false);
+extern void reset_timer();
+
+// Nested tic/toc pairs form a call tree per thread. show_timer_tree() prints
+// it indented with inclusive and exclusive time; write_timer_folded() emits
+// folded stacks for flamegraph tools.
+extern void show_timer_tree();
+extern void write_timer_folded(::std::ostream &out);
+
+// Counts cycles, instructions, cache misses, branch misses and page faults
+// per region through perf_event_open (Linux). Costs one read() per tic and
+// toc; counters the kernel refuses are skipped. Each thread's counters are
+// closed when the thread exits.
+extern void enable_timer_counters(bool enable=true);
+
+// Starts a background thread that takes the statistics of each interval
+// seconds and appends them to filepath as a JSON line, or rewrites it in
+// Prometheus text format. The reporter keeps its own baseline, so it does
+// not reset snapshot_timer() and reset_timer() does not disturb it; its min
+// and max come from the histogram. Replaces a running reporter; stopped at
+// exit.
+extern void start_timer_reporter(double interval,
+                                 const ::std::string &filepath,
+                                 timer_report_t format=TIMER_REPORT_JSON_LINES);
+extern void stop_timer_reporter();
+
+// Records every closed region into a per-thread ring buffer of the given
+// size, and optionally dumps it at exit. A later call with another size
+// takes effect at each thread's next event and drops what the thread had
+// recorded. write_timer_trace() writes the events as Chrome Trace Event JSON
+// for chrome://tracing or Perfetto; regions opened before the first start
+// begin at time 0.
+extern void start_timer_trace(size_t events_per_thread=1<<16,
+                              const ::std::string &dump_on_exit="");
+extern void stop_timer_trace();
+extern bool write_timer_trace(const ::std::string &filepath);
+
+// Resolves a region name to a key once, so that tic/toc on the returned
+// region do not hash or allocate.
+extern TimerRegion register_timer(const char name[]);
+extern void tic(TimerRegion region);
+extern void toc(TimerRegion region);
+
+#else
+
+inline void tic(const char []=TIMER_KEY_ALL) {}
+inline void toc(const char []=TIMER_KEY_ALL) {}
+inline void show_timer() {}
+inline ::std::vector<TimerStats> snapshot_timer(bool=false) {
+  return ::std::vector<TimerStats>();
+}
+inline void reset_timer() {}
+inline void show_timer_tree() {}
+inline void write_timer_folded(::std::ostream &) {}
+inline void enable_timer_counters(bool=true) {}
+inline void start_timer_reporter(double, const ::std::string &,
+                                 timer_report_t=TIMER_REPORT_JSON_LINES) {}
+inline void stop_timer_reporter() {}
+inline void start_timer_trace(size_t=0, const ::std::string & ="") {}
+inline void stop_timer_trace() {}
+inline bool write_timer_trace(const ::std::string &) {
+  return false;
+}
+inline TimerRegion register_timer(const char []) { return TimerRegion{0}; }
+inline void tic(TimerRegion) {}
+inline void toc(TimerRegion) {}
+
+#endif // TIMER_DISABLE
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(TimerRegion region) : _region(region) {
+    tic(_region);
+  }
+  ~ScopedTimer() {
+    toc(_region);
+  }
+private:
+  TimerRegion _region;
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer &operator=(const ScopedTimer &);
+};
 
 } // tool
 
 } // otita
 
+#define TIMER_CONCAT_(a, b) a##b
+#define TIMER_CONCAT(a, b) TIMER_CONCAT_(a, b)
+
+// Times the enclosing scope. The region key is registered once per call site
+// in a function-local static; defining TIMER_DISABLE compiles it away.
+#ifndef TIMER_DISABLE
+#define TIMER_SCOPE(name) \
+  static const ::otita::tool::TimerRegion TIMER_CONCAT(_timer_region_, __LINE__) = \
+    ::otita::tool::register_timer(name); \
+  ::otita::tool::ScopedTimer TIMER_CONCAT(_scoped_timer_, __LINE__)( \
+    TIMER_CONCAT(_timer_region_, __LINE__))
+#else
+#define TIMER_SCOPE(name) ((void)0)
+#endif
+
 #endif  // _TIMER_H_
@@ -0,0 +1,191 @@
+//
+//  binning_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest test/binning_test.cpp src/binning.cpp src/JSON.cpp -pthread
+
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "binning.h"
+
+using namespace std;
+using namespace otita::tool;
+
+struct Point {
+  float x;
+  int y;
+};
+
+// The same bins counted on one thread, value by value.
+static void _range(const Column &data, size_t len, double &lo, double &hi) {
+  lo = DBL_MAX;
+  hi = -DBL_MAX;
+  for (size_t i=0; i<len; i++) {
+    double value = data[i];
+    if (std::isfinite(value)) {
+      lo = min(lo, value);
+      hi = max(hi, value);
+    }
+  }
+  if (lo>hi) {
+    lo = 0;
+    hi = 1;
+  }
+  else if (lo==hi) {
+    lo -= 0.5;
+    hi += 0.5;
+  }
+}
+
+static long _bin(double value, double lo, double hi, size_t bins) {
+  double t = (value - lo)*(double(bins)/(hi - lo));
+  if (!(t>=0 && t<=double(bins))) {
+    return -1;
+  }
+  return long(min(t, double(bins - 1)));
+}
+
+static void _check1d(const Column &data, size_t len, size_t bins) {
+  double lo;
+  double hi;
+  vector<double> counts;
+  bin_1d(data, len, bins, lo, hi, counts);
+  double serial_lo;
+  double serial_hi;
+  _range(data, len, serial_lo, serial_hi);
+  vector<double> serial(bins, 0);
+  for (size_t i=0; i<len; i++) {
+    long bin = _bin(data[i], serial_lo, serial_hi, bins);
+    if (bin>=0) {
+      serial[size_t(bin)]++;
+    }
+  }
+  CHECK(lo==serial_lo && hi==serial_hi);
+  CHECK(counts==serial);
+}
+
+static void _check2d(const Column &x, const Column &y, size_t len, size_t nx, size_t ny) {
+  double bounds[4];
+  vector<double> counts;
+  bin_2d(x, y, len, nx, ny, bounds[0], bounds[1], bounds[2], bounds[3], counts);
+  double serial_bounds[4];
+  _range(x, len, serial_bounds[0], serial_bounds[1]);
+  _range(y, len, serial_bounds[2], serial_bounds[3]);
+  vector<double> serial(nx*ny, 0);
+  for (size_t i=0; i<len; i++) {
+    long ix = _bin(x[i], serial_bounds[0], serial_bounds[1], nx);
+    long iy = _bin(y[i], serial_bounds[2], serial_bounds[3], ny);
+    if (ix>=0 && iy>=0) {
+      serial[size_t(iy)*nx + size_t(ix)]++;
+    }
+  }
+  CHECK(equal(bounds, bounds + 4, serial_bounds));
+  CHECK(counts==serial);
+}
+
+int main() {
+  // several chunks of 1 << 16 so that every hardware thread counts
+  const size_t len = 1000003;
+  mt19937 random(11);
+  normal_distribution<double> normal(3, 2);
+  vector<double> values(len);
+  vector<Point> points(len);
+  for (size_t i=0; i<len; i++) {
+    values[i] = normal(random);
+    points[i].x = float(normal(random));
+    points[i].y = int(random()%1000) - 500;
+  }
+  values[7] = numeric_limits<double>::quiet_NaN();
+  values[len/2] = numeric_limits<double>::infinity();
+  values[len-1] = -numeric_limits<double>::infinity();
+  points[len/3].x = numeric_limits<float>::quiet_NaN();
+  
+  double total = 0;
+  double lo;
+  double hi;
+  vector<double> counts;
+  bin_1d(Column(values.data()), len, 100, lo, hi, counts);
+  for (double count : counts) {
+    total += count;
+  }
+  // everything but the NaN and the infinities
+  CHECK(total==double(len - 3));
+  
+  for (size_t bins : {size_t(1), size_t(7), size_t(100), size_t(5000)}) {
+    _check1d(Column(values.data()), len, bins);
+    _check1d(Column(&points[0], &Point::x), len, bins);
+    _check1d(Column(&points[0], &Point::y), len, bins);
+  }
+  _check2d(Column(values.data()), Column(&points[0], &Point::y), len, 64, 48);
+  _check2d(Column(&points[0], &Point::x), Column(values.data()), len, 1, 300);
+  
+  // hand-counted cases at the ends of the doubles: a constant too large for
+  // a margin of 0.5, and a range wider than DBL_MAX
+  for (double value : {1e17, 1e300, -1e300, DBL_MAX}) {
+    vector<double> large(300000, value);
+    bin_1d(Column(large.data()), large.size(), 5, lo, hi, counts);
+    CHECK(lo<value && value<=hi && std::isfinite(lo) && std::isfinite(hi));
+    vector<double> expected(5, 0);
+    expected[(value==DBL_MAX) ? 4 : 2] = double(large.size());
+    CHECK(counts==expected);
+    vector<double> zeros(large.size(), 0);
+    double bounds[4];
+    bin_2d(Column(large.data()), Column(zeros.data()), large.size(), 5, 1,
+           bounds[0], bounds[1], bounds[2], bounds[3], counts);
+    CHECK(counts==expected);
+  }
+  vector<double> wide(300000, 0);
+  wide[0] = -DBL_MAX;
+  wide[1] = DBL_MAX;
+  bin_1d(Column(wide.data()), wide.size(), 4, lo, hi, counts);
+  CHECK(lo==-DBL_MAX && hi==DBL_MAX);
+  CHECK(counts==vector<double>({1, 0, double(wide.size() - 2), 1}));
+  double bounds[4];
+  bin_2d(Column(wide.data()), Column(wide.data()), wide.size(), 4, 4,
+         bounds[0], bounds[1], bounds[2], bounds[3], counts);
+  vector<double> cells(16, 0);
+  cells[0] = 1;
+  cells[2*4 + 2] = double(wide.size() - 2);
+  cells[3*4 + 3] = 1;
+  CHECK(counts==cells);
+  
+  // all equal, and nothing finite
+  vector<double> same(200000, 4.25);
+  _check1d(Column(same.data()), same.size(), 10);
+  bin_1d(Column(same.data()), same.size(), 10, lo, hi, counts);
+  CHECK(lo==3.75 && hi==4.75);
+  vector<double> none(200000, numeric_limits<double>::quiet_NaN());
+  bin_1d(Column(none.data()), none.size(), 10, lo, hi, counts);
+  CHECK(lo==0 && hi==1 && counts==vector<double>(10, 0));
+  return check_result();
+}
@@ -0,0 +1,56 @@
+//
+//  check.h
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <iostream>
+
+// Minimal checks for the test programs: a failed CHECK is reported and
+// counted, and main() returns check_result().
+static int check_failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      ::std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #condition << ::std::endl; \
+      check_failures++; \
+    } \
+  } while (0)
+
+static inline int check_result() {
+  if (check_failures>0) {
+    ::std::cerr << check_failures << " check(s) failed" << ::std::endl;
+    return 1;
+  }
+  ::std::cout << "ok" << ::std::endl;
+  return 0;
+}
+
+#endif // _CHECK_H_
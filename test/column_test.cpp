@@ -0,0 +1,155 @@
+//
+//  column_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest test/column_test.cpp src/JSON.cpp
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "check.h"
+#include "Column.h"
+
+using namespace std;
+using namespace otita::tool;
+
+struct Sample {
+  int16_t id;
+  double time;
+  float value;
+};
+
+// n values from begin on, read through Column::read.
+static vector<double> _read(const Column &column, size_t begin, size_t n) {
+  vector<double> out(n, -1);
+  column.read(begin, n, out.data());
+  return out;
+}
+
+static void _checkContiguous() {
+  const double doubles[] = {0.5, -1, 2e300};
+  Column d(doubles);
+  CHECK(d.doubles()==doubles);
+  CHECK(_read(d, 0, 3)==vector<double>({0.5, -1, 2e300}));
+  CHECK(d[2]==2e300);
+  
+  const int ints[] = {3, -4, 5, 2147483647};
+  Column i(ints);
+  CHECK(i.doubles()==nullptr);
+  CHECK(_read(i, 1, 3)==vector<double>({-4, 5, 2147483647}));
+  
+  const float floats[] = {0.25f, -8.0f};
+  CHECK(_read(Column(floats), 0, 2)==vector<double>({0.25, -8}));
+  CHECK(Column().doubles()==nullptr);
+}
+
+// A stride in bytes that is not the element size: every third int, and
+// every other double, which are no longer contiguous doubles.
+static void _checkStride() {
+  const int ints[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  Column every3(ints, 3*sizeof(int));
+  CHECK(every3.doubles()==nullptr);
+  CHECK(_read(every3, 0, 4)==vector<double>({0, 3, 6, 9}));
+  CHECK(_read(every3, 2, 2)==vector<double>({6, 9}));
+  CHECK(every3[3]==9);
+  
+  const double doubles[] = {1, -1, 2, -2, 3, -3};
+  Column odd(doubles + 1, 2*sizeof(double));
+  CHECK(odd.doubles()==nullptr);
+  CHECK(_read(odd, 0, 3)==vector<double>({-1, -2, -3}));
+}
+
+static void _checkField() {
+  const Sample samples[] = {{7, 0.5, 1.5f}, {-8, 1.0, -2.5f}, {9, 1.5, 4.0f}};
+  Column ids(samples, &Sample::id);
+  Column times(samples, &Sample::time);
+  Column values(samples, &Sample::value);
+  CHECK(ids.doubles()==nullptr);
+  CHECK(times.doubles()==nullptr);
+  CHECK(_read(ids, 0, 3)==vector<double>({7, -8, 9}));
+  CHECK(_read(times, 1, 2)==vector<double>({1.0, 1.5}));
+  CHECK(_read(values, 0, 3)==vector<double>({1.5, -2.5, 4}));
+  CHECK(values[1]==-2.5);
+  
+  // a null array is an empty column: no pointer is formed from it and
+  // reading nothing touches nothing
+  Column empty(static_cast<const Sample *>(nullptr), &Sample::time);
+  CHECK(empty.doubles()==nullptr);
+  CHECK(_read(empty, 0, 0).empty());
+}
+
+static void _checkJSON() {
+  unique_ptr<JSON> array(JSON::parse("[1, 2.5, -3e2, 0]"));
+  CHECK(array && array->type()==JSON::JSON_ARRAY);
+  if (array) {
+    Column column(*array);
+    CHECK(column.doubles()==nullptr);
+    CHECK(_read(column, 0, 4)==vector<double>({1, 2.5, -300, 0}));
+    CHECK(_read(column, 2, 1)==vector<double>({-300}));
+    CHECK(column[1]==2.5);
+  }
+  
+  // the numbers around a non-numeric entry still read; reading the entry
+  // itself throws
+  unique_ptr<JSON> mixed(JSON::parse("[1, \"two\", null, 4, [5]]"));
+  CHECK(mixed && mixed->type()==JSON::JSON_ARRAY);
+  if (mixed) {
+    Column column(*mixed);
+    CHECK(_read(column, 0, 1)==vector<double>({1}));
+    CHECK(_read(column, 3, 1)==vector<double>({4}));
+    const size_t entries[] = {1, 2, 4};
+    for (size_t entry : entries) {
+      bool threw = false;
+      try {
+        column[entry];
+      }
+      catch (const logic_error &) {
+        threw = true;
+      }
+      CHECK(threw);
+    }
+    bool threw = false;
+    try {
+      _read(column, 0, 4);
+    }
+    catch (const logic_error &) {
+      threw = true;
+    }
+    CHECK(threw);
+  }
+}
+
+int main() {
+  _checkContiguous();
+  _checkStride();
+  _checkField();
+  _checkJSON();
+  return check_result();
+}
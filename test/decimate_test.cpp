@@ -0,0 +1,116 @@
+//
+//  decimate_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest test/decimate_test.cpp src/decimate.cpp src/JSON.cpp -pthread
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "check.h"
+#include "decimate.h"
+
+using namespace std;
+using namespace otita::tool;
+
+typedef void (*Decimate)(const double *, const double *, size_t, size_t,
+                         vector<double> &, vector<double> &);
+
+static size_t _nans(const vector<double> &values) {
+  size_t count = 0;
+  for (double value : values) {
+    count += std::isnan(value);
+  }
+  return count;
+}
+
+static void _check(Decimate decimate, size_t bound) {
+  // long enough to be split across threads
+  const size_t len = 300000;
+  const size_t max_points = 1000;
+  vector<double> x(len);
+  vector<double> y(len);
+  for (size_t i=0; i<len; i++) {
+    x[i] = 0.5*i;
+    y[i] = sin(i*0.001) + ((i%7==0) ? 0.25 : 0);
+  }
+  vector<double> x_out;
+  vector<double> y_out;
+  
+  for (int with_x=0; with_x<2; with_x++) {
+    decimate(with_x ? x.data() : nullptr, y.data(), len, max_points, x_out, y_out);
+    CHECK(x_out.size()==y_out.size());
+    CHECK(!x_out.empty() && x_out.size()<=bound);
+    CHECK(x_out.front()==0 && y_out.front()==y.front());
+    CHECK(x_out.back()==(with_x ? x.back() : double(len-1)) && y_out.back()==y.back());
+    bool increasing = true;
+    for (size_t i=1; i<x_out.size(); i++) {
+      increasing &= x_out[i]>x_out[i-1];
+    }
+    CHECK(increasing);
+  }
+  
+  // short series are copied
+  decimate(nullptr, y.data(), 10, max_points, x_out, y_out);
+  CHECK(x_out.size()==10 && y_out[9]==y[9]);
+  
+  // a NaN gap survives, and does not hide the extremes around it
+  vector<double> gap(y);
+  const double nan = numeric_limits<double>::quiet_NaN();
+  for (size_t i=150500; i<150510; i++) {
+    gap[i] = nan;
+  }
+  gap[100000] = 10;
+  gap[200000] = -10;
+  decimate(nullptr, gap.data(), len, max_points, x_out, y_out);
+  CHECK(x_out.size()<=bound);
+  CHECK(_nans(y_out)>=1);
+  CHECK(y_out.front()==gap.front() && y_out.back()==gap.back());
+  bool high = false;
+  bool low = false;
+  for (double value : y_out) {
+    high |= value==10;
+    low |= value==-10;
+  }
+  CHECK(high && low);
+  
+  // a leading NaN does not poison its bucket
+  gap[0] = nan;
+  decimate(nullptr, gap.data(), len, max_points, x_out, y_out);
+  CHECK(std::isnan(y_out.front()));
+  CHECK(_nans(y_out)<=2*bound/max_points + 2);
+  CHECK(y_out.back()==gap.back());
+}
+
+int main() {
+  // min/max keeps at most four points per bucket of max_points/4
+  _check(decimate_minmax, 1000);
+  _check(decimate_lttb, 1000);
+  return check_result();
+}
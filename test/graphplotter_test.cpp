@@ -0,0 +1,117 @@
+//
+//  graphplotter_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest '-DGNUPLOT="cat >graphplotter_test.gp"' test/graphplotter_test.cpp src/GraphPlotter.cpp src/GnuplotPool.cpp src/Figure.cpp src/decimate.cpp src/binning.cpp src/JSON.cpp -pthread
+//
+// gnuplot is replaced by cat, which keeps the commands it would be sent.
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "check.h"
+#include "GraphPlotter.h"
+
+using namespace std;
+using namespace otita::tool;
+
+static const char *_commands = "graphplotter_test.gp";
+static const char *_image = "graphplotter_test.png";
+
+static bool _read(const char *path, string &contents) {
+  ifstream in(path, ios::binary);
+  if (!in.is_open()) {
+    return false;
+  }
+  stringstream buffer;
+  buffer << in.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+static bool _contains(const string &text, const string &part) {
+  return text.find(part)!=string::npos;
+}
+
+// BACKEND_AUTO draws a .png in-process until an equation needs gnuplot.
+static void _checkAuto(bool async) {
+  remove(_commands);
+  remove(_image);
+  vector<double> y = {1, 4, 9, 16};
+  {
+    GraphPlotter plotter(_image);
+    if (async) {
+      plotter.async();
+    }
+    plotter.plot(y.data(), y.size(), "with lines title 'squares'");
+    plotter.plot("sin(x)");
+    plotter.plot(y.data(), y.size(), "with points");
+    plotter.flush().get();
+  }
+  string commands;
+  CHECK(_read(_commands, commands));
+  CHECK(_contains(commands, "set terminal png size 640,480\n"));
+  CHECK(_contains(commands, string("set output '") + _image + "'\n"));
+  size_t plot = commands.find("\nplot ");
+  CHECK(plot!=string::npos);
+  string line = commands.substr(plot + 1, commands.find('\n', plot + 1) - plot - 1);
+  size_t squares = line.find("using 1 with lines title 'squares'");
+  size_t sine = line.find(", sin(x), ");
+  size_t points = line.find("using 1 with points");
+  CHECK(squares!=string::npos && sine!=string::npos && points!=string::npos);
+  CHECK(squares<sine && sine<points);
+  // nothing was drawn natively
+  string image;
+  CHECK(!_read(_image, image));
+  remove(_commands);
+}
+
+static void _checkNative() {
+  remove(_commands);
+  remove(_image);
+  vector<double> y = {1, 4, 9, 16};
+  {
+    GraphPlotter plotter(_image);
+    plotter.plot(y.data(), y.size(), "with lines");
+  }
+  string image;
+  CHECK(_read(_image, image));
+  CHECK(image.compare(0, 8, "\x89PNG\r\n\x1a\n")==0);
+  string commands;
+  CHECK(!_read(_commands, commands));
+  remove(_image);
+}
+
+int main() {
+  _checkAuto(false);
+  _checkAuto(true);
+  _checkNative();
+  return check_result();
+}
@@ -0,0 +1,179 @@
+//
+//  png_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest test/png_test.cpp src/JSON.cpp -pthread -lz
+
+#include <fstream>
+#include <random>
+
+#include <zlib.h>
+
+#include "check.h"
+// for the file-local encoder
+#include "Figure.cpp"
+
+using namespace std;
+
+static bool _inflate(const vector<unsigned char> &compressed,
+                     size_t size,
+                     vector<unsigned char> &data) {
+  data.assign(size + 1, 0);
+  uLongf len = uLongf(data.size());
+  int status = uncompress(data.data(), &len, compressed.data(), uLong(compressed.size()));
+  data.resize(len);
+  return status==Z_OK;
+}
+
+static void _roundTrip(const vector<unsigned char> &data) {
+  vector<unsigned char> compressed = _zlib(data);
+  vector<unsigned char> inflated;
+  CHECK(_inflate(compressed, data.size(), inflated));
+  CHECK(inflated==data);
+}
+
+static void _checkZlib() {
+  mt19937 random(7);
+  vector<unsigned char> data;
+  _roundTrip(data);
+  data.assign(1, 42);
+  _roundTrip(data);
+  data.assign(100000, 0xff);
+  _roundTrip(data);
+  // random bytes are literals only
+  data.resize(70000);
+  for (unsigned char &byte : data) {
+    byte = random() & 0xff;
+  }
+  _roundTrip(data);
+  // repeats at every length and at distances up to and beyond the window
+  vector<unsigned char> pattern(data.begin(), data.begin() + 40000);
+  data.clear();
+  for (size_t length=3; length<=300; length++) {
+    size_t offset = random()%30000;
+    data.insert(data.end(), pattern.begin() + offset, pattern.begin() + offset + length);
+    data.push_back(random() & 0xff);
+  }
+  data.insert(data.end(), pattern.begin(), pattern.end());
+  data.insert(data.end(), pattern.begin(), pattern.end());
+  _roundTrip(data);
+  // few symbols, the shape of a plot
+  data.resize(1 << 20);
+  for (size_t i=0; i<data.size(); i++) {
+    data[i] = (random()%50==0) ? 0x94 : 0xff;
+  }
+  _roundTrip(data);
+  
+  CHECK(_crc(data.data(), data.size())==crc32(0, data.data(), uInt(data.size())));
+  CHECK(_adler32(data.data(), data.size())==adler32(1, data.data(), uInt(data.size())));
+}
+
+static uint32_t _be32(const unsigned char *p) {
+  return (uint32_t(p[0])<<24) | (uint32_t(p[1])<<16) | (uint32_t(p[2])<<8) | p[3];
+}
+
+// Reads the file back chunk by chunk, checking every CRC, and inflates the
+// image data.
+static void _checkPNG() {
+  const char *path = "png_test.png";
+  Figure figure;
+  vector<double> x(200);
+  vector<double> y(200);
+  for (size_t i=0; i<x.size(); i++) {
+    x[i] = double(i);
+    y[i] = sin(0.05*i);
+  }
+  size_t series = figure.add("with lines title 'sin'");
+  figure.set(series, x.data(), y.data(), x.size());
+  CHECK(figure.write(path));
+  
+  ifstream in(path, ios::binary);
+  vector<unsigned char> file((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  remove(path);
+  CHECK(file.size()>8 && memcmp(file.data(), "\x89PNG\r\n\x1a\n", 8)==0);
+  
+  vector<string> types;
+  vector<unsigned char> header;
+  vector<unsigned char> idat;
+  size_t pos = 8;
+  while (pos+12<=file.size()) {
+    uint32_t len = _be32(&file[pos]);
+    if (pos+12+len>file.size()) {
+      break;
+    }
+    const unsigned char *type = &file[pos+4];
+    const unsigned char *data = &file[pos+8];
+    CHECK(_be32(data + len)==crc32(0, type, 4 + len));
+    types.push_back(string(reinterpret_cast<const char *>(type), 4));
+    if (types.back()=="IHDR") {
+      header.assign(data, data + len);
+    }
+    else if (types.back()=="IDAT") {
+      idat.insert(idat.end(), data, data + len);
+    }
+    pos += 12 + len;
+  }
+  CHECK(pos==file.size());
+  CHECK(types.size()==3 && types[0]=="IHDR" && types[1]=="IDAT" && types[2]=="IEND");
+  CHECK(header.size()==13);
+  if (header.size()!=13) {
+    return;
+  }
+  uint32_t width = _be32(&header[0]);
+  uint32_t height = _be32(&header[4]);
+  CHECK(width==640 && height==480);
+  // 8-bit RGB, deflate, no filter, no interlace
+  CHECK(header[8]==8 && header[9]==2 && header[10]==0 && header[11]==0 && header[12]==0);
+  
+  size_t stride = width*3 + 1;
+  vector<unsigned char> raw;
+  CHECK(_inflate(idat, stride*height, raw));
+  CHECK(raw.size()==stride*height);
+  if (raw.size()!=stride*height) {
+    return;
+  }
+  size_t filtered = 0;
+  size_t white = 0;
+  for (size_t row=0; row<height; row++) {
+    filtered += raw[row*stride]!=0;
+    for (size_t i=0; i<width; i++) {
+      const unsigned char *rgb = &raw[row*stride + 1 + 3*i];
+      white += rgb[0]==0xff && rgb[1]==0xff && rgb[2]==0xff;
+    }
+  }
+  CHECK(filtered==0);
+  // a white background with the axes and the curve on it
+  CHECK(raw[1]==0xff && raw[2]==0xff && raw[3]==0xff);
+  CHECK(white>width*height/2 && white<width*height);
+}
+
+int main() {
+  _checkZlib();
+  _checkPNG();
+  return check_result();
+}
@@ -0,0 +1,337 @@
+//
+//  timer_test.cpp
+//
+//  Created by otita on 2026/10/19.
+//
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 otita.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// g++ -std=c++11 -Isrc -Itest test/timer_test.cpp src/JSON.cpp -pthread
+
+#include <thread>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <cstdio>
+
+#include "check.h"
+
+// A clock the tests can set, or the steady clock while it is off.
+static bool _manual_clock = false;
+static int64_t _manual_ns = 0;
+
+static int64_t _testClock() {
+  if (_manual_clock) {
+    return _manual_ns;
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#define TIMER_CLOCK _testClock
+// for the file-local Histogram
+#include "timer.cpp"
+
+using namespace std;
+using namespace otita::tool;
+
+static void _sleep(int ms) {
+  this_thread::sleep_for(chrono::milliseconds(ms));
+}
+
+static const TimerStats *_find(const vector<TimerStats> &stats, const string &name) {
+  for (const TimerStats &s : stats) {
+    if (s.name==name) {
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+static void testBuckets() {
+  for (int64_t v=0; v<int64_t(Histogram::SUB_BUCKETS); v++) {
+    CHECK(Histogram::bucket(v)==size_t(v));
+    CHECK(Histogram::value(size_t(v))==double(v));
+  }
+  CHECK(Histogram::bucket(-5)==0);
+  CHECK(Histogram::bucket(INT64_MAX)<Histogram::BUCKETS);
+  mt19937_64 rng(1);
+  size_t last = 0;
+  for (double v=16; v<1e15; v*=1.01) {
+    size_t bucket = Histogram::bucket(int64_t(v));
+    CHECK(bucket>=last);
+    last = bucket;
+    int64_t value = int64_t(rng() >> (rng() % 60));
+    if (value>=16) {
+      // the middle of a sub-bucket is within 1/32 of anything in it
+      double error = fabs(Histogram::value(Histogram::bucket(value)) - double(value))/double(value);
+      CHECK(error<=1.0/32);
+    }
+  }
+}
+
+static void testPercentiles() {
+  vector<uint64_t> counts(Histogram::BUCKETS, 0);
+  counts[Histogram::bucket(100)] = 990;
+  counts[Histogram::bucket(1000000)] = 10;
+  CHECK(fabs(Histogram::percentile(counts, 1000, 0.5) - 100)<=100.0/32);
+  CHECK(fabs(Histogram::percentile(counts, 1000, 0.99) - 100)<=100.0/32);
+  CHECK(fabs(Histogram::percentile(counts, 1000, 0.999) - 1e6)<=1e6/32);
+  CHECK(Histogram::percentile(vector<uint64_t>(Histogram::BUCKETS, 0), 0, 0.5)==0);
+}
+
+// min and max live in two windows that alternate with the reset epoch; a
+// window left from two resets ago must not leak into the current one.
+static void testEpochWindows() {
+  tic("epoch");
+  _sleep(20);
+  toc("epoch");
+  vector<TimerStats> first = snapshot_timer();
+  const TimerStats *s = _find(first, "epoch");
+  CHECK(s!=nullptr && s->count==1 && s->max>=0.02 && s->min==s->max);
+  
+  vector<TimerStats> before = snapshot_timer(true);
+  CHECK(_find(before, "epoch")!=nullptr);
+  CHECK(_find(snapshot_timer(), "epoch")==nullptr);
+  
+  tic("epoch");
+  toc("epoch");
+  vector<TimerStats> second = snapshot_timer();
+  s = _find(second, "epoch");
+  CHECK(s!=nullptr && s->count==1 && s->max<0.01);
+  
+  reset_timer();
+  reset_timer();
+  tic("epoch");
+  toc("epoch");
+  tic("epoch");
+  _sleep(2);
+  toc("epoch");
+  vector<TimerStats> after = snapshot_timer();
+  s = _find(after, "epoch");
+  CHECK(s!=nullptr && s->count==2);
+  if (s!=nullptr) {
+    CHECK(s->max>=0.002 && s->max<0.02);
+    CHECK(s->min<=s->max && s->min<0.002);
+    CHECK(s->min<=s->p50 && s->p50<=s->p999 && s->p999<=s->max);
+  }
+}
+
+// Statistics are reported in seconds, converted as the timer does.
+static double _seconds(int64_t ns) {
+  return ns/1e9;
+}
+
+// Sets the manual clock in microseconds.
+static void _at(int64_t us) {
+  _manual_ns = us*1000;
+}
+
+static string _tree() {
+  stringstream out;
+  streambuf *stdout_buffer = cout.rdbuf(out.rdbuf());
+  show_timer_tree();
+  cout.rdbuf(stdout_buffer);
+  return out.str();
+}
+
+static string _folded() {
+  stringstream out;
+  write_timer_folded(out);
+  return out.str();
+}
+
+// Inclusive time of a parent is its exclusive time plus its children's.
+static void testTree() {
+  _manual_clock = true;
+  reset_timer();
+  for (int64_t base=0; base<200; base+=100) {
+    _at(base);
+    tic("tree_a");
+    _at(base + 10);
+    tic("tree_b");
+    _at(base + 30);
+    toc("tree_b");
+    _at(base + 35);
+    tic("tree_c");
+    _at(base + 40);
+    toc("tree_c");
+    _at(base + 50);
+    toc("tree_a");
+  }
+  CHECK(_tree()==
+        "tree_a: 0.0001(s) self 5e-05(s) [count 2]\n"
+        "  tree_b: 4e-05(s) self 4e-05(s) [count 2]\n"
+        "  tree_c: 1e-05(s) self 1e-05(s) [count 2]\n");
+  CHECK(_folded()==
+        "tree_a 50\n"
+        "tree_a;tree_b 40\n"
+        "tree_a;tree_c 10\n");
+  _manual_clock = false;
+}
+
+// tic A, tic B, toc A, toc B times A and B by their own tic and toc. B
+// stays under A in the tree, and the stack is empty afterwards.
+static void testOutOfOrder() {
+  _manual_clock = true;
+  reset_timer();
+  _at(0);
+  tic("ooo_a");
+  _at(10);
+  tic("ooo_b");
+  _at(30);
+  toc("ooo_a");
+  _at(80);
+  toc("ooo_b");
+  _at(90);
+  tic("ooo_c");
+  _at(95);
+  toc("ooo_c");
+  vector<TimerStats> stats = snapshot_timer();
+  const TimerStats *a = _find(stats, "ooo_a");
+  const TimerStats *b = _find(stats, "ooo_b");
+  CHECK(a!=nullptr && a->count==1 && a->total==_seconds(30000));
+  CHECK(b!=nullptr && b->count==1 && b->total==_seconds(70000));
+  CHECK(_tree()==
+        "ooo_a: 3e-05(s) self 0(s) [count 1]\n"
+        "  ooo_b: 7e-05(s) self 7e-05(s) [count 1]\n"
+        "ooo_c: 5e-06(s) self 5e-06(s) [count 1]\n");
+  CHECK(_folded()==
+        "ooo_a;ooo_b 70\n"
+        "ooo_c 5\n");
+  _manual_clock = false;
+}
+
+// A toc on a closed region adds the lap since its previous toc; a tic on an
+// open region restarts it.
+static void testLaps() {
+  _manual_clock = true;
+  reset_timer();
+  _at(0);
+  tic("lap");
+  _at(10);
+  toc("lap");
+  _at(25);
+  toc("lap");
+  _at(30);
+  tic("lap");
+  _at(40);
+  tic("lap");
+  _at(45);
+  toc("lap");
+  vector<TimerStats> stats = snapshot_timer();
+  const TimerStats *lap = _find(stats, "lap");
+  CHECK(lap!=nullptr && lap->count==3 && lap->total==_seconds(30000));
+  CHECK(lap!=nullptr && lap->min==_seconds(5000) && lap->max==_seconds(15000));
+  CHECK(_folded()=="lap 30\n");
+  _manual_clock = false;
+}
+
+// The complete events of regions whose names start with "trace_", as
+// (name, ts, dur), from a file that must parse as Chrome Trace JSON.
+static bool _readTrace(const string &path, vector<pair<string, pair<double, double> > > &events) {
+  ifstream in(path.c_str());
+  stringstream buffer;
+  buffer << in.rdbuf();
+  unique_ptr<JSON> trace(JSON::parse(buffer.str()));
+  if (!trace || trace->type()!=JSON::JSON_OBJECT ||
+      (*trace)["traceEvents"].type()!=JSON::JSON_ARRAY ||
+      (*trace)["displayTimeUnit"].string()!="ms") {
+    return false;
+  }
+  const JSON &list = (*trace)["traceEvents"];
+  events.clear();
+  for (size_t i=0; i<list.size(); i++) {
+    const JSON &event = list[i];
+    if (event["pid"].type()!=JSON::JSON_NUMBER || event["tid"].type()!=JSON::JSON_NUMBER) {
+      return false;
+    }
+    if (event["ph"].string()!="X" || event["name"].string().compare(0, 6, "trace_")!=0) {
+      continue;
+    }
+    events.push_back(make_pair(event["name"].string(),
+                               make_pair(event["ts"].number(), event["dur"].number())));
+  }
+  return true;
+}
+
+// Regions opened before the first start are cut at time 0, and a new size
+// drops what was recorded.
+static void testTrace() {
+  const string path = "timer_test_trace.json";
+  vector<pair<string, pair<double, double> > > events;
+  _manual_clock = true;
+  _at(1000);
+  tic("trace_early");
+  _at(1100);
+  start_timer_trace(4);
+  _at(1150);
+  toc("trace_early");
+  _at(1200);
+  tic("trace_late");
+  _at(1210);
+  toc("trace_late");
+  CHECK(write_timer_trace(path));
+  CHECK(_readTrace(path, events));
+  CHECK(events.size()==2);
+  if (events.size()==2) {
+    CHECK(events[0].first=="trace_early" && events[0].second==make_pair(0.0, 50.0));
+    CHECK(events[1].first=="trace_late" && events[1].second==make_pair(100.0, 10.0));
+  }
+  
+  start_timer_trace(2);
+  const char *names[] = {"trace_r1", "trace_r2", "trace_\"r3\""};
+  for (int64_t i=0; i<3; i++) {
+    _at(1300 + 10*i);
+    tic(names[i]);
+    _at(1301 + 10*i);
+    toc(names[i]);
+  }
+  stop_timer_trace();
+  _at(1400);
+  tic("trace_stopped");
+  toc("trace_stopped");
+  CHECK(write_timer_trace(path));
+  CHECK(_readTrace(path, events));
+  CHECK(events.size()==2);
+  if (events.size()==2) {
+    CHECK(events[0].first=="trace_r2" && events[0].second==make_pair(210.0, 1.0));
+    CHECK(events[1].first=="trace_\"r3\"" && events[1].second==make_pair(220.0, 1.0));
+  }
+  remove(path.c_str());
+  _manual_clock = false;
+}
+
+int main() {
+  testBuckets();
+  testPercentiles();
+  testEpochWindows();
+  testTree();
+  testOutOfOrder();
+  testLaps();
+  testTrace();
+  return check_result();
+}